@@ -0,0 +1,372 @@
+/* buffer_cache.c: Sector cache in front of the file system disk.
+ *
+ * Every inode and file data sector read or written by the file system
+ * goes through a fixed set of BC_SIZE cached sectors, found by sector
+ * number through a hash table.  Writes only dirty the cached copy; a
+ * write that covers a whole sector does not read it first.
+ *
+ * A sector to drop is chosen by the CLOCK algorithm: the hand sweeps
+ * the entries, giving each one that was used since the last sweep a
+ * second chance.  A dirty victim is written back before its entry is
+ * reused.
+ *
+ * The "flushd" thread wakes up every BC_FLUSH_INTERVAL ticks and
+ * writes back the sectors that have stayed dirty for BC_DIRTY_EXPIRE
+ * ticks or more, so that a crash loses only recent writes without
+ * writing a sector out on every small change.  Everything dirty is
+ * written at filesys_done().
+ *
+ * Sectors the file layer expects to be read soon are queued with
+ * buffer_cache_readahead() and loaded by the "readahead" thread, so
+ * that the reader computes while the disk works.  A full queue drops
+ * the request; it was only a hint.
+ *
+ * Metadata is written with buffer_cache_write_meta(), which also
+ * logs the sector in the journal.  Such a sector is pinned: it is
+ * neither written back nor dropped until the journal has committed
+ * it and written it home itself.
+ *
+ * One lock, held across disk I/O, protects the whole cache. */
+
+#include "filesys/buffer_cache.h"
+#include <debug.h>
+#include <hash.h>
+#include <inttypes.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include "devices/timer.h"
+#include "filesys/filesys.h"
+#include "filesys/journal.h"
+#include "threads/palloc.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
+
+/* Number of cached sectors, 64 sectors being 8 pages. */
+#define BC_SIZE 64
+
+/* How often flushd runs, and how long a sector may stay dirty. */
+#define BC_FLUSH_INTERVAL (TIMER_FREQ)
+#define BC_DIRTY_EXPIRE (5 * TIMER_FREQ)
+
+/* Most sectors waiting to be read ahead. */
+#define BC_RA_QUEUE 64
+
+/* One cached sector. */
+struct bc_entry {
+	struct hash_elem elem;         /* In bc_map while valid. */
+	disk_sector_t sector;          /* Sector held. */
+	bool valid;                    /* Holds a sector. */
+	bool dirty;                    /* Newer than the disk. */
+	bool accessed;                 /* Used since the hand last passed. */
+	bool prefetched;               /* Read ahead, not yet used. */
+	bool pinned;                   /* Journaled, not yet home. */
+	uint64_t jseq;                 /* Transaction that last logged it. */
+	int64_t dirty_since;           /* Tick the entry became dirty. */
+	uint8_t *data;                 /* DISK_SECTOR_SIZE bytes. */
+};
+
+static struct bc_entry bc_entries[BC_SIZE];
+static struct hash bc_map;             /* Valid entries by sector. */
+static struct lock bc_lock;
+static size_t bc_hand;                 /* Next entry CLOCK looks at. */
+static struct condition bc_unpinned;   /* Broadcast when unpinned. */
+
+/* Ring of sectors to read ahead. */
+static disk_sector_t bc_ra_queue[BC_RA_QUEUE];
+static size_t bc_ra_head, bc_ra_cnt;
+static struct condition bc_ra_work;    /* Signaled when queued. */
+
+/* Statistics. */
+static uint64_t bc_hit_cnt;            /* Accesses found in the cache. */
+static uint64_t bc_miss_cnt;           /* Accesses that had to load. */
+static uint64_t bc_noread_cnt;         /* Misses for whole-sector writes. */
+static uint64_t bc_writeback_cnt;      /* Dirty sectors written. */
+static uint64_t bc_ra_read_cnt;        /* Sectors read ahead. */
+static uint64_t bc_ra_hit_cnt;         /* ...and used afterwards. */
+static uint64_t bc_ra_drop_cnt;        /* Requests dropped, queue full. */
+
+static void flushd (void *aux UNUSED);
+static void readahead (void *aux UNUSED);
+
+static uint64_t
+bc_hash (const struct hash_elem *e, void *aux UNUSED) {
+	const struct bc_entry *b = hash_entry (e, struct bc_entry, elem);
+	return hash_bytes (&b->sector, sizeof b->sector);
+}
+
+static bool
+bc_less (const struct hash_elem *a, const struct hash_elem *b,
+		void *aux UNUSED) {
+	return hash_entry (a, struct bc_entry, elem)->sector
+		< hash_entry (b, struct bc_entry, elem)->sector;
+}
+
+void
+buffer_cache_init (void) {
+	uint8_t *data;
+	size_t i;
+
+	lock_init (&bc_lock);
+	cond_init (&bc_ra_work);
+	cond_init (&bc_unpinned);
+	if (!hash_init (&bc_map, bc_hash, bc_less, NULL))
+		PANIC ("buffer cache: out of memory");
+	data = palloc_get_multiple (PAL_ASSERT,
+			BC_SIZE * DISK_SECTOR_SIZE / PGSIZE);
+	for (i = 0; i < BC_SIZE; i++) {
+		bc_entries[i].valid = false;
+		bc_entries[i].data = data + i * DISK_SECTOR_SIZE;
+	}
+	thread_create ("flushd", PRI_DEFAULT, flushd, NULL);
+	thread_create ("readahead", PRI_DEFAULT, readahead, NULL);
+}
+
+/* Writes B back if it is dirty.  Must hold bc_lock. */
+static void
+bc_clean (struct bc_entry *b) {
+	ASSERT (lock_held_by_current_thread (&bc_lock));
+
+	if (b->valid && b->dirty && !b->pinned) {
+		disk_write (filesys_disk, b->sector, b->data);
+		b->dirty = false;
+		bc_writeback_cnt++;
+	}
+}
+
+/* Returns the entry holding SECTOR, or a null pointer. */
+static struct bc_entry *
+bc_lookup (disk_sector_t sector) {
+	struct bc_entry key;
+	struct hash_elem *e;
+
+	key.sector = sector;
+	e = hash_find (&bc_map, &key.elem);
+	return e != NULL ? hash_entry (e, struct bc_entry, elem) : NULL;
+}
+
+/* Frees an entry by CLOCK, writing back its sector if needed, and
+ * returns it.  Waits for the journal if every entry is pinned. */
+static struct bc_entry *
+bc_evict (void) {
+	size_t pinned_run = 0;
+
+	for (;;) {
+		struct bc_entry *b = &bc_entries[bc_hand];
+
+		bc_hand = (bc_hand + 1) % BC_SIZE;
+		if (!b->valid)
+			return b;
+		if (b->pinned) {
+			if (++pinned_run == BC_SIZE) {
+				cond_wait (&bc_unpinned, &bc_lock);
+				pinned_run = 0;
+			}
+			continue;
+		}
+		pinned_run = 0;
+		if (b->accessed) {
+			b->accessed = false;
+			continue;
+		}
+		bc_clean (b);
+		hash_delete (&bc_map, &b->elem);
+		b->valid = false;
+		return b;
+	}
+}
+
+/* Returns the entry for SECTOR, loading it on a miss unless the
+ * caller is about to overwrite all of it (FILL is false).  Must hold
+ * bc_lock. */
+static struct bc_entry *
+bc_get (disk_sector_t sector, bool fill) {
+	struct bc_entry *b = bc_lookup (sector);
+
+	if (b != NULL) {
+		bc_hit_cnt++;
+		if (b->prefetched) {
+			b->prefetched = false;
+			bc_ra_hit_cnt++;
+		}
+	} else {
+		bc_miss_cnt++;
+		b = bc_evict ();
+		b->sector = sector;
+		b->dirty = false;
+		b->prefetched = false;
+		b->pinned = false;
+		if (fill)
+			disk_read (filesys_disk, sector, b->data);
+		else
+			bc_noread_cnt++;
+		b->valid = true;
+		hash_insert (&bc_map, &b->elem);
+	}
+	b->accessed = true;
+	return b;
+}
+
+/* Copies SIZE bytes at offset OFS of SECTOR into BUFFER. */
+void
+buffer_cache_read (disk_sector_t sector, void *buffer, size_t ofs,
+		size_t size) {
+	struct bc_entry *b;
+
+	ASSERT (ofs + size <= DISK_SECTOR_SIZE);
+
+	lock_acquire (&bc_lock);
+	b = bc_get (sector, true);
+	memcpy (buffer, b->data + ofs, size);
+	lock_release (&bc_lock);
+}
+
+/* Copies SIZE bytes from BUFFER to offset OFS of SECTOR. */
+void
+buffer_cache_write (disk_sector_t sector, const void *buffer, size_t ofs,
+		size_t size) {
+	struct bc_entry *b;
+
+	ASSERT (ofs + size <= DISK_SECTOR_SIZE);
+
+	lock_acquire (&bc_lock);
+	b = bc_get (sector, ofs != 0 || size != DISK_SECTOR_SIZE);
+	memcpy (b->data + ofs, buffer, size);
+	if (!b->dirty) {
+		b->dirty = true;
+		b->dirty_since = timer_ticks ();
+	}
+	lock_release (&bc_lock);
+}
+
+/* Copies SIZE bytes from BUFFER to offset OFS of metadata SECTOR,
+ * logging the result in the journal.  The sector stays pinned until
+ * the journal writes it home. */
+void
+buffer_cache_write_meta (disk_sector_t sector, const void *buffer,
+		size_t ofs, size_t size) {
+	struct bc_entry *b;
+
+	if (!journal_enabled) {
+		buffer_cache_write (sector, buffer, ofs, size);
+		return;
+	}
+
+	ASSERT (ofs + size <= DISK_SECTOR_SIZE);
+
+	journal_start ();
+	lock_acquire (&bc_lock);
+	b = bc_get (sector, ofs != 0 || size != DISK_SECTOR_SIZE);
+	memcpy (b->data + ofs, buffer, size);
+	b->pinned = true;
+	b->jseq = journal_log (sector, b->data);
+	lock_release (&bc_lock);
+	journal_stop ();
+}
+
+/* Called by the journal once transaction SEQ has written SECTOR
+ * home.  Unpins it unless a later transaction logged it again. */
+void
+buffer_cache_unpin (disk_sector_t sector, uint64_t seq) {
+	struct bc_entry *b;
+
+	lock_acquire (&bc_lock);
+	b = bc_lookup (sector);
+	if (b != NULL && b->pinned && b->jseq == seq) {
+		b->pinned = false;
+		cond_broadcast (&bc_unpinned, &bc_lock);
+	}
+	lock_release (&bc_lock);
+}
+
+/* Asks for SECTOR to be loaded in the background. */
+void
+buffer_cache_readahead (disk_sector_t sector) {
+	lock_acquire (&bc_lock);
+	if (bc_ra_cnt == BC_RA_QUEUE)
+		bc_ra_drop_cnt++;
+	else {
+		bc_ra_queue[(bc_ra_head + bc_ra_cnt++) % BC_RA_QUEUE] = sector;
+		cond_signal (&bc_ra_work, &bc_lock);
+	}
+	lock_release (&bc_lock);
+}
+
+/* Loads the queued sectors that are not cached yet. */
+static void
+readahead (void *aux UNUSED) {
+	lock_acquire (&bc_lock);
+	for (;;) {
+		disk_sector_t sector;
+
+		while (bc_ra_cnt == 0)
+			cond_wait (&bc_ra_work, &bc_lock);
+		sector = bc_ra_queue[bc_ra_head];
+		bc_ra_head = (bc_ra_head + 1) % BC_RA_QUEUE;
+		bc_ra_cnt--;
+
+		if (bc_lookup (sector) == NULL) {
+			struct bc_entry *b = bc_evict ();
+
+			b->sector = sector;
+			b->dirty = false;
+			b->accessed = false;
+			b->prefetched = true;
+			b->pinned = false;
+			disk_read (filesys_disk, sector, b->data);
+			b->valid = true;
+			hash_insert (&bc_map, &b->elem);
+			bc_ra_read_cnt++;
+		}
+	}
+}
+
+/* Writes back every dirty sector dirtied at or before tick
+ * DEADLINE. */
+static void
+bc_flush_before (int64_t deadline) {
+	size_t i;
+
+	lock_acquire (&bc_lock);
+	for (i = 0; i < BC_SIZE; i++)
+		if (bc_entries[i].dirty && bc_entries[i].dirty_since <= deadline)
+			bc_clean (&bc_entries[i]);
+	lock_release (&bc_lock);
+}
+
+/* Writes back every dirty sector. */
+void
+buffer_cache_flush (void) {
+	bc_flush_before (INT64_MAX);
+}
+
+/* Writes everything out before the machine goes down. */
+void
+buffer_cache_done (void) {
+	buffer_cache_flush ();
+}
+
+/* Periodically writes back the sectors that have been dirty for
+ * a while. */
+static void
+flushd (void *aux UNUSED) {
+	for (;;) {
+		timer_sleep (BC_FLUSH_INTERVAL);
+		bc_flush_before (timer_ticks () - BC_DIRTY_EXPIRE);
+	}
+}
+
+void
+buffer_cache_print_stats (void) {
+	uint64_t total = bc_hit_cnt + bc_miss_cnt;
+
+	printf ("Buffer cache: %"PRIu64" hits, %"PRIu64" misses (%"PRIu64"%% hit "
+			"rate), %"PRIu64" whole-sector writes not read, "
+			"%"PRIu64" sectors written back\n", bc_hit_cnt, bc_miss_cnt,
+			total > 0 ? bc_hit_cnt * 100 / total : 0, bc_noread_cnt,
+			bc_writeback_cnt);
+	printf ("Buffer cache: %"PRIu64" sectors read ahead, %"PRIu64" used, "
+			"%"PRIu64" requests dropped\n", bc_ra_read_cnt, bc_ra_hit_cnt,
+			bc_ra_drop_cnt);
+}
@@ -0,0 +1,197 @@
+/* dcache.c: Cache of directory name lookups.
+ *
+ * Maps a directory's inode sector and a name to the inode sector the
+ * name refers to and the offset of its directory entry, or records
+ * that the name does not exist.  Opening, creating or removing a
+ * cached name then skips the directory's slots entirely.
+ *
+ * The directory code keeps the cache in step with the disk: every
+ * successful dir_add() stores a positive entry and every dir_remove()
+ * a negative one, so a cached answer is always current.  At most
+ * DCACHE_MAX names are kept; the least recently used goes first. */
+
+#include "filesys/dcache.h"
+#include <hash.h>
+#include <inttypes.h>
+#include <list.h>
+#include <stdio.h>
+#include <string.h>
+#include "filesys/directory.h"
+#include "threads/malloc.h"
+#include "threads/synch.h"
+
+/* Most names cached at once. */
+#define DCACHE_MAX 128
+
+/* One cached name. */
+struct dentry {
+	struct hash_elem elem;         /* In dcache_map. */
+	struct list_elem lru_elem;     /* In dcache_lru, newest at front. */
+	disk_sector_t dir;             /* Directory's inode sector. */
+	char name[NAME_MAX + 1];       /* Name in DIR. */
+	bool negative;                 /* NAME does not exist in DIR. */
+	disk_sector_t sector;          /* NAME's inode sector. */
+	off_t ofs;                     /* Offset of NAME's entry in DIR. */
+};
+
+static struct hash dcache_map;
+static struct list dcache_lru;
+static size_t dcache_cnt;
+static struct lock dcache_lock;
+
+/* Statistics. */
+static uint64_t dcache_hit_cnt;        /* Names found. */
+static uint64_t dcache_neg_cnt;        /* Names known missing. */
+static uint64_t dcache_miss_cnt;       /* Names not cached. */
+
+static uint64_t
+dentry_hash (const struct hash_elem *e, void *aux UNUSED) {
+	const struct dentry *d = hash_entry (e, struct dentry, elem);
+	return hash_string (d->name) ^ hash_int (d->dir);
+}
+
+static bool
+dentry_less (const struct hash_elem *a_, const struct hash_elem *b_,
+		void *aux UNUSED) {
+	const struct dentry *a = hash_entry (a_, struct dentry, elem);
+	const struct dentry *b = hash_entry (b_, struct dentry, elem);
+
+	if (a->dir != b->dir)
+		return a->dir < b->dir;
+	return strcmp (a->name, b->name) < 0;
+}
+
+void
+dcache_init (void) {
+	if (!hash_init (&dcache_map, dentry_hash, dentry_less, NULL))
+		PANIC ("dcache: out of memory");
+	list_init (&dcache_lru);
+	lock_init (&dcache_lock);
+}
+
+/* Returns the cached entry for NAME in DIR, or a null pointer.  Must
+ * hold dcache_lock. */
+static struct dentry *
+dentry_find (disk_sector_t dir, const char *name) {
+	struct dentry key;
+	struct hash_elem *e;
+
+	key.dir = dir;
+	strlcpy (key.name, name, sizeof key.name);
+	e = hash_find (&dcache_map, &key.elem);
+	return e != NULL ? hash_entry (e, struct dentry, elem) : NULL;
+}
+
+/* Drops D from the cache.  Must hold dcache_lock. */
+static void
+dentry_free (struct dentry *d) {
+	hash_delete (&dcache_map, &d->elem);
+	list_remove (&d->lru_elem);
+	dcache_cnt--;
+	free (d);
+}
+
+/* Looks up NAME in directory DIR.  On DCACHE_HIT, sets *SECTOR and
+ * *OFS. */
+enum dcache_result
+dcache_lookup (disk_sector_t dir, const char *name,
+		disk_sector_t *sector, off_t *ofs) {
+	enum dcache_result result = DCACHE_MISS;
+	struct dentry *d;
+
+	/* Longer names cannot exist, and would not fit the key. */
+	if (strlen (name) > NAME_MAX)
+		return DCACHE_MISS;
+
+	lock_acquire (&dcache_lock);
+	d = dentry_find (dir, name);
+	if (d == NULL)
+		dcache_miss_cnt++;
+	else {
+		list_remove (&d->lru_elem);
+		list_push_front (&dcache_lru, &d->lru_elem);
+		if (d->negative) {
+			result = DCACHE_NEGATIVE;
+			dcache_neg_cnt++;
+		} else {
+			*sector = d->sector;
+			*ofs = d->ofs;
+			result = DCACHE_HIT;
+			dcache_hit_cnt++;
+		}
+	}
+	lock_release (&dcache_lock);
+	return result;
+}
+
+/* Caches what is known about NAME in DIR, replacing any older
+ * entry. */
+static void
+dcache_store (disk_sector_t dir, const char *name, bool negative,
+		disk_sector_t sector, off_t ofs) {
+	struct dentry *d;
+
+	if (strlen (name) > NAME_MAX)
+		return;
+
+	lock_acquire (&dcache_lock);
+	d = dentry_find (dir, name);
+	if (d != NULL)
+		list_remove (&d->lru_elem);
+	else {
+		if (dcache_cnt >= DCACHE_MAX)
+			dentry_free (list_entry (list_back (&dcache_lru),
+						struct dentry, lru_elem));
+		d = malloc (sizeof *d);
+		if (d == NULL) {
+			lock_release (&dcache_lock);
+			return;
+		}
+		d->dir = dir;
+		strlcpy (d->name, name, sizeof d->name);
+		hash_insert (&dcache_map, &d->elem);
+		dcache_cnt++;
+	}
+	d->negative = negative;
+	d->sector = sector;
+	d->ofs = ofs;
+	list_push_front (&dcache_lru, &d->lru_elem);
+	lock_release (&dcache_lock);
+}
+
+/* Records that NAME in DIR refers to inode SECTOR, with its entry at
+ * offset OFS. */
+void
+dcache_insert (disk_sector_t dir, const char *name,
+		disk_sector_t sector, off_t ofs) {
+	dcache_store (dir, name, false, sector, ofs);
+}
+
+/* Records that DIR has no entry for NAME. */
+void
+dcache_insert_negative (disk_sector_t dir, const char *name) {
+	dcache_store (dir, name, true, 0, 0);
+}
+
+/* Drops every name cached for directory DIR, which is going away. */
+void
+dcache_forget_dir (disk_sector_t dir) {
+	struct list_elem *e;
+
+	lock_acquire (&dcache_lock);
+	for (e = list_begin (&dcache_lru); e != list_end (&dcache_lru); ) {
+		struct dentry *d = list_entry (e, struct dentry, lru_elem);
+
+		e = list_next (e);
+		if (d->dir == dir)
+			dentry_free (d);
+	}
+	lock_release (&dcache_lock);
+}
+
+void
+dcache_print_stats (void) {
+	printf ("Name cache: %"PRIu64" hits, %"PRIu64" negative hits, "
+			"%"PRIu64" misses\n", dcache_hit_cnt, dcache_neg_cnt,
+			dcache_miss_cnt);
+}
@@ -1,10 +1,13 @@
 #include "filesys/directory.h"
 #include <stdio.h>
 #include <string.h>
+#include <hash.h>
 #include <list.h>
+#include "filesys/dcache.h"
 #include "filesys/filesys.h"
 #include "filesys/inode.h"
 #include "threads/malloc.h"
+#include "threads/synch.h"
 
 /* A directory. */
 struct dir {
@@ -19,6 +22,179 @@ struct dir_entry {
 	bool in_use;                        /* In use or free? */
 };
 
+/* Index of a large directory: every name in use, by name, with the
+ * offset of its entry, kept beside the linear entries on disk, which
+ * stay as they are.  A directory gets one when it has DIR_INDEX_MIN
+ * slots or more, built by one pass over its entries the first time it
+ * is searched, so lookups and dir_add() no longer read every entry.
+ * Smaller directories are searched linearly.  Only the DIR_INDEX_MAX
+ * most recently used directories keep theirs. */
+#define DIR_INDEX_MIN 32
+#define DIR_INDEX_MAX 8
+
+struct dir_index {
+	struct list_elem elem;              /* Element in dir_indexes. */
+	disk_sector_t sector;               /* Sector of the directory. */
+	struct hash names;                  /* index_entry by name. */
+	off_t free_ofs;                     /* No free slot before this. */
+};
+
+/* Name in use in an indexed directory. */
+struct index_entry {
+	struct hash_elem elem;              /* Element in names. */
+	disk_sector_t inode_sector;         /* Sector number of header. */
+	off_t ofs;                          /* Offset of the entry. */
+	char name[NAME_MAX + 1];            /* Null terminated file name. */
+};
+
+/* Directory indexes, most recently used first. */
+static struct list dir_indexes;
+static size_t dir_index_cnt;
+static struct lock dir_index_lock;
+
+static uint64_t
+index_entry_hash (const struct hash_elem *e, void *aux UNUSED) {
+	return hash_string (hash_entry (e, struct index_entry, elem)->name);
+}
+
+static bool
+index_entry_less (const struct hash_elem *a, const struct hash_elem *b,
+		void *aux UNUSED) {
+	return strcmp (hash_entry (a, struct index_entry, elem)->name,
+			hash_entry (b, struct index_entry, elem)->name) < 0;
+}
+
+static void
+index_entry_free (struct hash_elem *e, void *aux UNUSED) {
+	free (hash_entry (e, struct index_entry, elem));
+}
+
+/* Frees INDEX, which is off dir_indexes. */
+static void
+dir_index_free (struct dir_index *index) {
+	hash_destroy (&index->names, index_entry_free);
+	free (index);
+}
+
+/* Returns the entry for NAME in INDEX, or a null pointer. */
+static struct index_entry *
+dir_index_find (struct dir_index *index, const char *name) {
+	struct index_entry key;
+	struct hash_elem *e;
+
+	strlcpy (key.name, name, sizeof key.name);
+	e = hash_find (&index->names, &key.elem);
+	return e != NULL ? hash_entry (e, struct index_entry, elem) : NULL;
+}
+
+/* Records that NAME, whose inode is in INODE_SECTOR, has its entry at
+ * OFS in INDEX.  Returns false if out of memory. */
+static bool
+dir_index_insert (struct dir_index *index, const char *name,
+		disk_sector_t inode_sector, off_t ofs) {
+	struct index_entry *ie = malloc (sizeof *ie);
+
+	if (ie == NULL)
+		return false;
+	ie->inode_sector = inode_sector;
+	ie->ofs = ofs;
+	strlcpy (ie->name, name, sizeof ie->name);
+	hash_insert (&index->names, &ie->elem);
+	return true;
+}
+
+/* Drops INDEX, which can no longer be trusted; it is built again
+ * the next time it is needed. */
+static void
+dir_index_drop (struct dir_index *index) {
+	ASSERT (lock_held_by_current_thread (&dir_index_lock));
+
+	list_remove (&index->elem);
+	dir_index_cnt--;
+	dir_index_free (index);
+}
+
+/* Returns the index of DIR, reading every entry of DIR to build it if
+ * needed, with dir_index_lock held.  Returns a null pointer, and DIR
+ * is searched linearly, if DIR is small or memory runs out. */
+static struct dir_index *
+dir_index_get (const struct dir *dir) {
+	disk_sector_t sector = inode_get_inumber (dir->inode);
+	struct dir_index *index;
+	struct list_elem *el;
+	struct dir_entry e;
+	off_t ofs;
+
+	ASSERT (lock_held_by_current_thread (&dir_index_lock));
+
+	for (el = list_begin (&dir_indexes); el != list_end (&dir_indexes);
+			el = list_next (el)) {
+		index = list_entry (el, struct dir_index, elem);
+		if (index->sector == sector) {
+			list_remove (el);
+			list_push_front (&dir_indexes, el);
+			return index;
+		}
+	}
+
+	if (inode_length (dir->inode)
+			< (off_t) (DIR_INDEX_MIN * sizeof (struct dir_entry)))
+		return NULL;
+	index = malloc (sizeof *index);
+	if (index == NULL)
+		return NULL;
+	if (!hash_init (&index->names, index_entry_hash, index_entry_less, NULL)) {
+		free (index);
+		return NULL;
+	}
+	index->sector = sector;
+	index->free_ofs = -1;
+	for (ofs = 0; inode_read_at (dir->inode, &e, sizeof e, ofs) == sizeof e;
+			ofs += sizeof e) {
+		if (!e.in_use) {
+			if (index->free_ofs < 0)
+				index->free_ofs = ofs;
+		} else if (!dir_index_insert (index, e.name, e.inode_sector, ofs)) {
+			dir_index_free (index);
+			return NULL;
+		}
+	}
+	if (index->free_ofs < 0)
+		index->free_ofs = ofs;
+
+	list_push_front (&dir_indexes, &index->elem);
+	if (++dir_index_cnt > DIR_INDEX_MAX)
+		dir_index_drop (list_entry (list_back (&dir_indexes),
+					struct dir_index, elem));
+	return index;
+}
+
+/* Drops the index of directory SECTOR, if any, because the directory
+ * is going away. */
+static void
+dir_index_forget (disk_sector_t sector) {
+	struct list_elem *el;
+
+	lock_acquire (&dir_index_lock);
+	for (el = list_begin (&dir_indexes); el != list_end (&dir_indexes);
+			el = list_next (el)) {
+		struct dir_index *index = list_entry (el, struct dir_index, elem);
+
+		if (index->sector == sector) {
+			dir_index_drop (index);
+			break;
+		}
+	}
+	lock_release (&dir_index_lock);
+}
+
+/* Initializes the directory module. */
+void
+dir_init (void) {
+	list_init (&dir_indexes);
+	lock_init (&dir_index_lock);
+}
+
 /* Creates a directory with space for ENTRY_CNT entries in the
  * given SECTOR.  Returns true if successful, false on failure. */
 bool
@@ -32,6 +208,7 @@ struct dir *
 dir_open (struct inode *inode) {
 	struct dir *dir = calloc (1, sizeof *dir);
 	if (inode != NULL && dir != NULL) {
+		inode_set_meta (inode);
 		dir->inode = inode;
 		dir->pos = 0;
 		return dir;
@@ -75,26 +252,70 @@ dir_get_inode (struct dir *dir) {
  * If successful, returns true, sets *EP to the directory entry
  * if EP is non-null, and sets *OFSP to the byte offset of the
  * directory entry if OFSP is non-null.
- * otherwise, returns false and ignores EP and OFSP. */
+ * otherwise, returns false and ignores EP and OFSP.
+ * Answers from the name cache when it can, and caches what it finds
+ * in the index or on disk. */
 static bool
 lookup (const struct dir *dir, const char *name,
 		struct dir_entry *ep, off_t *ofsp) {
+	disk_sector_t dir_sector, sector;
+	struct dir_index *index;
 	struct dir_entry e;
-	size_t ofs;
+	off_t ofs;
+	bool found = false;
 
 	ASSERT (dir != NULL);
 	ASSERT (name != NULL);
 
-	for (ofs = 0; inode_read_at (dir->inode, &e, sizeof e, ofs) == sizeof e;
-			ofs += sizeof e)
-		if (e.in_use && !strcmp (name, e.name)) {
-			if (ep != NULL)
-				*ep = e;
+	dir_sector = inode_get_inumber (dir->inode);
+	switch (dcache_lookup (dir_sector, name, &sector, &ofs)) {
+		case DCACHE_HIT:
+			if (ep != NULL) {
+				ep->inode_sector = sector;
+				strlcpy (ep->name, name, sizeof ep->name);
+				ep->in_use = true;
+			}
 			if (ofsp != NULL)
 				*ofsp = ofs;
 			return true;
+		case DCACHE_NEGATIVE:
+			return false;
+		case DCACHE_MISS:
+			break;
+	}
+
+	lock_acquire (&dir_index_lock);
+	index = dir_index_get (dir);
+	if (index != NULL) {
+		struct index_entry *ie = dir_index_find (index, name);
+
+		if (ie != NULL) {
+			e.inode_sector = ie->inode_sector;
+			strlcpy (e.name, name, sizeof e.name);
+			e.in_use = true;
+			ofs = ie->ofs;
+			found = true;
 		}
-	return false;
+	} else {
+		for (ofs = 0; inode_read_at (dir->inode, &e, sizeof e, ofs) == sizeof e;
+				ofs += sizeof e)
+			if (e.in_use && !strcmp (name, e.name)) {
+				found = true;
+				break;
+			}
+	}
+	lock_release (&dir_index_lock);
+
+	if (!found) {
+		dcache_insert_negative (dir_sector, name);
+		return false;
+	}
+	dcache_insert (dir_sector, name, e.inode_sector, ofs);
+	if (ep != NULL)
+		*ep = e;
+	if (ofsp != NULL)
+		*ofsp = ofs;
+	return true;
 }
 
 /* Searches DIR for a file with the given NAME
@@ -125,6 +346,7 @@ dir_lookup (const struct dir *dir, const char *name,
  * error occurs. */
 bool
 dir_add (struct dir *dir, const char *name, disk_sector_t inode_sector) {
+	struct dir_index *index;
 	struct dir_entry e;
 	off_t ofs;
 	bool success = false;
@@ -140,14 +362,18 @@ dir_add (struct dir *dir, const char *name, disk_sector_t inode_sector) {
 	if (lookup (dir, name, NULL, NULL))
 		goto done;
 
-	/* Set OFS to offset of free slot.
+	/* Set OFS to offset of free slot, starting where the index says
+	 * the first free slot may be.
 	 * If there are no free slots, then it will be set to the
 	 * current end-of-file.
 
 	 * inode_read_at() will only return a short read at end of file.
 	 * Otherwise, we'd need to verify that we didn't get a short
 	 * read due to something intermittent such as low memory. */
-	for (ofs = 0; inode_read_at (dir->inode, &e, sizeof e, ofs) == sizeof e;
+	lock_acquire (&dir_index_lock);
+	index = dir_index_get (dir);
+	for (ofs = index != NULL ? index->free_ofs : 0;
+			inode_read_at (dir->inode, &e, sizeof e, ofs) == sizeof e;
 			ofs += sizeof e)
 		if (!e.in_use)
 			break;
@@ -157,6 +383,14 @@ dir_add (struct dir *dir, const char *name, disk_sector_t inode_sector) {
 	strlcpy (e.name, name, sizeof e.name);
 	e.inode_sector = inode_sector;
 	success = inode_write_at (dir->inode, &e, sizeof e, ofs) == sizeof e;
+	if (success && index != NULL) {
+		index->free_ofs = ofs + sizeof e;
+		if (!dir_index_insert (index, name, inode_sector, ofs))
+			dir_index_drop (index);
+	}
+	lock_release (&dir_index_lock);
+	if (success)
+		dcache_insert (inode_get_inumber (dir->inode), name, inode_sector, ofs);
 
 done:
 	return success;
@@ -167,6 +401,7 @@ done:
  * which occurs only if there is no file with the given NAME. */
 bool
 dir_remove (struct dir *dir, const char *name) {
+	struct dir_index *index;
 	struct dir_entry e;
 	struct inode *inode = NULL;
 	bool success = false;
@@ -186,8 +421,26 @@ dir_remove (struct dir *dir, const char *name) {
 
 	/* Erase directory entry. */
 	e.in_use = false;
-	if (inode_write_at (dir->inode, &e, sizeof e, ofs) != sizeof e)
+	lock_acquire (&dir_index_lock);
+	if (inode_write_at (dir->inode, &e, sizeof e, ofs) != sizeof e) {
+		lock_release (&dir_index_lock);
 		goto done;
+	}
+	index = dir_index_get (dir);
+	if (index != NULL) {
+		struct index_entry *ie = dir_index_find (index, name);
+
+		if (ie != NULL) {
+			hash_delete (&index->names, &ie->elem);
+			free (ie);
+		}
+		if (ofs < index->free_ofs)
+			index->free_ofs = ofs;
+	}
+	lock_release (&dir_index_lock);
+	dcache_insert_negative (inode_get_inumber (dir->inode), name);
+	dcache_forget_dir (e.inode_sector);
+	dir_index_forget (e.inode_sector);
 
 	/* Remove inode. */
 	inode_remove (inode);
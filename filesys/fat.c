@@ -1,6 +1,8 @@
 #include "filesys/fat.h"
 #include "devices/disk.h"
 #include "filesys/filesys.h"
+#include "filesys/free-extent.h"
+#include "filesys/journal.h"
 #include "threads/malloc.h"
 #include "threads/synch.h"
 #include <stdio.h>
@@ -24,6 +26,7 @@ struct fat_fs {
 	disk_sector_t data_start;
 	cluster_t last_clst;
 	struct lock write_lock;
+	struct free_extents free_runs; /* Free clusters, as runs. */
 };
 
 static struct fat_fs *fat_fs;
@@ -31,6 +34,25 @@ static struct fat_fs *fat_fs;
 void fat_boot_create (void);
 void fat_fs_init (void);
 
+/* Rebuilds the free cluster runs from the FAT. */
+static void
+fat_build_runs (void) {
+	cluster_t c = 1;
+
+	free_extents_clear (&fat_fs->free_runs);
+	while (c < fat_fs->fat_length) {
+		cluster_t start;
+
+		if (fat_fs->fat[c] != 0) {
+			c++;
+			continue;
+		}
+		for (start = c; c < fat_fs->fat_length && fat_fs->fat[c] == 0; c++)
+			continue;
+		free_extents_add (&fat_fs->free_runs, start, c - start);
+	}
+}
+
 void
 fat_init (void) {
 	fat_fs = calloc (1, sizeof (struct fat_fs));
@@ -78,6 +100,7 @@ fat_open (void) {
 			free (bounce);
 		}
 	}
+	fat_build_runs ();
 }
 
 void
@@ -127,6 +150,11 @@ fat_create (void) {
 	// Set up ROOT_DIR_CLST
 	fat_put (ROOT_DIR_CLUSTER, EOChain);
 
+	// Reserve the journal's clusters, right after it
+	for (cluster_t c = JOURNAL_CLUSTER; c < JOURNAL_CLUSTER + JOURNAL_SECTORS; c++)
+		fat_put (c, c + 1 < JOURNAL_CLUSTER + JOURNAL_SECTORS ? c + 1 : EOChain);
+	fat_build_runs ();
+
 	// Fill up ROOT_DIR_CLUSTER region with 0
 	uint8_t *buf = calloc (1, DISK_SECTOR_SIZE);
 	if (buf == NULL)
@@ -152,7 +180,14 @@ fat_boot_create (void) {
 
 void
 fat_fs_init (void) {
-	/* TODO: Your code goes here. */
+	/* The data area follows the FAT.  Cluster 0 means "no cluster", so
+	 * cluster C lives at data_start + C - 1. */
+	fat_fs->data_start = fat_fs->bs.fat_start + fat_fs->bs.fat_sectors;
+	fat_fs->fat_length = (fat_fs->bs.total_sectors - fat_fs->data_start)
+		/ SECTORS_PER_CLUSTER;
+	fat_fs->last_clst = ROOT_DIR_CLUSTER;
+	lock_init (&fat_fs->write_lock);
+	free_extents_init (&fat_fs->free_runs);
 }
 
 /*----------------------------------------------------------------------------*/
@@ -164,30 +199,113 @@ fat_fs_init (void) {
  * Returns 0 if fails to allocate a new cluster. */
 cluster_t
 fat_create_chain (cluster_t clst) {
-	/* TODO: Your code goes here. */
+	return fat_extend_chain (clst, 1, clst != 0 ? clst + 1 : 0);
+}
+
+/* Adds CNT clusters to the chain, or starts a new chain of CNT
+ * clusters if CLST is 0, and returns the first new cluster.  The
+ * clusters are taken as few runs as possible, the first starting at
+ * HINT if it is free and otherwise from the smallest free run that
+ * fits them all.  Returns 0, adding nothing, if there is not enough
+ * room. */
+cluster_t
+fat_extend_chain (cluster_t clst, size_t cnt, cluster_t hint) {
+	cluster_t first = 0, last = clst;
+
+	ASSERT (cnt > 0);
+
+	lock_acquire (&fat_fs->write_lock);
+	if (fat_fs->free_runs.free_cnt < cnt) {
+		lock_release (&fat_fs->write_lock);
+		return 0;
+	}
+	while (cnt > 0) {
+		uint32_t start;
+		size_t got = free_extents_alloc_some (&fat_fs->free_runs, cnt, hint,
+				&start);
+		size_t i;
+
+		if (got == 0)
+			break;
+		for (i = 0; i < got; i++) {
+			cluster_t c = start + i;
+
+			ASSERT (fat_fs->fat[c] == 0);
+			fat_fs->fat[c] = EOChain;
+			if (last != 0)
+				fat_fs->fat[last] = c;
+			if (first == 0)
+				first = c;
+			last = c;
+		}
+		fat_fs->last_clst = last;
+		cnt -= got;
+		hint = last + 1;
+	}
+	lock_release (&fat_fs->write_lock);
+
+	/* Runs were lost to a memory shortage; give back what was
+	 * taken. */
+	if (cnt > 0 && first != 0) {
+		fat_remove_chain (first, clst);
+		first = 0;
+	}
+	return first;
 }
 
 /* Remove the chain of clusters starting from CLST.
  * If PCLST is 0, assume CLST as the start of the chain. */
 void
 fat_remove_chain (cluster_t clst, cluster_t pclst) {
-	/* TODO: Your code goes here. */
+	cluster_t run_start = 0, run_end = 0;
+
+	lock_acquire (&fat_fs->write_lock);
+	if (pclst != 0)
+		fat_fs->fat[pclst] = EOChain;
+	while (clst != 0 && clst != EOChain) {
+		cluster_t next;
+
+		ASSERT (clst < fat_fs->fat_length);
+		next = fat_fs->fat[clst];
+		fat_fs->fat[clst] = 0;
+
+		/* Hand back consecutive clusters as one run. */
+		if (run_end != clst) {
+			free_extents_add (&fat_fs->free_runs, run_start,
+					run_end - run_start);
+			run_start = clst;
+		}
+		run_end = clst + 1;
+		clst = next;
+	}
+	free_extents_add (&fat_fs->free_runs, run_start, run_end - run_start);
+	lock_release (&fat_fs->write_lock);
 }
 
 /* Update a value in the FAT table. */
 void
 fat_put (cluster_t clst, cluster_t val) {
-	/* TODO: Your code goes here. */
+	ASSERT (clst > 0 && clst < fat_fs->fat_length);
+	fat_fs->fat[clst] = val;
 }
 
 /* Fetch a value in the FAT table. */
 cluster_t
 fat_get (cluster_t clst) {
-	/* TODO: Your code goes here. */
+	ASSERT (clst > 0 && clst < fat_fs->fat_length);
+	return fat_fs->fat[clst];
 }
 
 /* Covert a cluster # to a sector number. */
 disk_sector_t
 cluster_to_sector (cluster_t clst) {
-	/* TODO: Your code goes here. */
+	ASSERT (clst > 0 && clst < fat_fs->fat_length);
+	return fat_fs->data_start + (clst - 1) * SECTORS_PER_CLUSTER;
+}
+
+/* Covert a sector number to the cluster # holding it. */
+cluster_t
+sector_to_cluster (disk_sector_t sector) {
+	ASSERT (sector >= fat_fs->data_start);
+	return (sector - fat_fs->data_start) / SECTORS_PER_CLUSTER + 1;
 }
@@ -3,11 +3,20 @@
 #include "filesys/inode.h"
 #include "threads/malloc.h"
 
+/* Bounds of the readahead window. */
+#define RA_MIN (4 * DISK_SECTOR_SIZE)
+#define RA_MAX (32 * DISK_SECTOR_SIZE)
+
 /* An open file. */
 struct file {
 	struct inode *inode;        /* File's inode. */
 	off_t pos;                  /* Current position. */
 	bool deny_write;            /* Has file_deny_write() been called? */
+
+	/* Readahead. */
+	off_t ra_next;              /* Where a sequential read starts. */
+	off_t ra_end;               /* End of what was read ahead. */
+	off_t ra_window;            /* Bytes to keep ahead, 0 if random. */
 };
 
 /* Opens a file for the given INODE, of which it takes ownership,
@@ -64,6 +73,36 @@ file_get_inode (struct file *file) {
 	return file->inode;
 }
 
+/* Notes that BYTES were just read from FILE at OFS.  A read that
+ * continues the previous one doubles the readahead window, up to
+ * RA_MAX, and has the sectors past it up to the window loaded in the
+ * background; any other read closes the window. */
+static void
+file_readahead (struct file *file, off_t ofs, off_t bytes) {
+	off_t end = ofs + bytes;
+
+	if (bytes <= 0)
+		return;
+	if (ofs != file->ra_next) {
+		file->ra_window = 0;
+		file->ra_end = 0;
+	} else if (file->ra_window == 0)
+		file->ra_window = RA_MIN;
+	else if (file->ra_window < RA_MAX)
+		file->ra_window *= 2;
+	file->ra_next = end;
+
+	if (file->ra_window == 0)
+		return;
+	if (file->ra_end < end)
+		file->ra_end = end;
+	if (file->ra_end < end + file->ra_window) {
+		inode_readahead (file->inode, end + file->ra_window - file->ra_end,
+				file->ra_end);
+		file->ra_end = end + file->ra_window;
+	}
+}
+
 /* Reads SIZE bytes from FILE into BUFFER,
  * starting at the file's current position.
  * Returns the number of bytes actually read,
@@ -72,6 +111,7 @@ file_get_inode (struct file *file) {
 off_t
 file_read (struct file *file, void *buffer, off_t size) {
 	off_t bytes_read = inode_read_at (file->inode, buffer, size, file->pos);
+	file_readahead (file, file->pos, bytes_read);
 	file->pos += bytes_read;
 	return bytes_read;
 }
@@ -83,7 +123,9 @@ file_read (struct file *file, void *buffer, off_t size) {
  * The file's current position is unaffected. */
 off_t
 file_read_at (struct file *file, void *buffer, off_t size, off_t file_ofs) {
-	return inode_read_at (file->inode, buffer, size, file_ofs);
+	off_t bytes_read = inode_read_at (file->inode, buffer, size, file_ofs);
+	file_readahead (file, file_ofs, bytes_read);
+	return bytes_read;
 }
 
 /* Writes SIZE bytes from BUFFER into FILE,
@@ -0,0 +1,218 @@
+/* free-extent.c: Free space kept as runs of free blocks.
+ *
+ * The free map and the FAT record which blocks are free one block at
+ * a time, so finding room used to mean scanning them from the start,
+ * and whatever was found first was taken.  This keeps, next to them,
+ * the free blocks as a list of maximal runs sorted by start, and
+ * allocates from it with a placement policy:
+ *
+ *   - A run that starts at HINT, or contains HINT with enough room
+ *     after it, is used there, so a file grows in place and a file's
+ *     data lands right after its inode.
+ *   - Otherwise the smallest run that fits is used (best fit), which
+ *     leaves the large runs whole for large files.
+ *
+ * The list holds one node per run, so its cost follows the
+ * fragmentation of the disk rather than its size.  Callers serialize
+ * with their own lock, and mark the blocks in their own map too. */
+
+#include "filesys/free-extent.h"
+#include <debug.h>
+#include "threads/malloc.h"
+
+/* A run of free blocks. */
+struct free_run {
+	struct list_elem elem;
+	uint32_t start;
+	size_t cnt;
+};
+
+void
+free_extents_init (struct free_extents *fe) {
+	list_init (&fe->runs);
+	fe->run_cnt = 0;
+	fe->free_cnt = 0;
+}
+
+/* Forgets all free space in FE. */
+void
+free_extents_clear (struct free_extents *fe) {
+	while (!list_empty (&fe->runs))
+		free (list_entry (list_pop_front (&fe->runs), struct free_run, elem));
+	fe->run_cnt = 0;
+	fe->free_cnt = 0;
+}
+
+/* Adds the CNT blocks from START, which must not be free already, to
+ * FE, merging them with the runs on either side.  If a new run is
+ * needed and memory is short, the blocks stay unknown to FE until it
+ * is rebuilt; they are still free on disk. */
+void
+free_extents_add (struct free_extents *fe, uint32_t start, size_t cnt) {
+	struct list_elem *e;
+	struct free_run *prev = NULL, *next = NULL, *r;
+
+	if (cnt == 0)
+		return;
+
+	for (e = list_begin (&fe->runs); e != list_end (&fe->runs);
+			e = list_next (e)) {
+		r = list_entry (e, struct free_run, elem);
+		if (r->start > start) {
+			next = r;
+			break;
+		}
+		prev = r;
+	}
+	ASSERT (prev == NULL || prev->start + prev->cnt <= start);
+	ASSERT (next == NULL || start + cnt <= next->start);
+
+	fe->free_cnt += cnt;
+	if (prev != NULL && prev->start + prev->cnt == start) {
+		prev->cnt += cnt;
+		if (next != NULL && start + cnt == next->start) {
+			prev->cnt += next->cnt;
+			list_remove (&next->elem);
+			free (next);
+			fe->run_cnt--;
+		}
+	} else if (next != NULL && start + cnt == next->start) {
+		next->start = start;
+		next->cnt += cnt;
+	} else {
+		r = malloc (sizeof *r);
+		if (r == NULL) {
+			fe->free_cnt -= cnt;
+			return;
+		}
+		r->start = start;
+		r->cnt = cnt;
+		if (next != NULL)
+			list_insert (&next->elem, &r->elem);
+		else
+			list_push_back (&fe->runs, &r->elem);
+		fe->run_cnt++;
+	}
+}
+
+/* Takes CNT blocks at START out of run R, which holds them. */
+static void
+run_take (struct free_extents *fe, struct free_run *r, uint32_t start,
+		size_t cnt) {
+	uint32_t end = start + cnt, r_end = r->start + r->cnt;
+
+	ASSERT (start >= r->start && end <= r_end);
+
+	fe->free_cnt -= cnt;
+	if (start == r->start) {
+		r->start = end;
+		r->cnt -= cnt;
+		if (r->cnt == 0) {
+			list_remove (&r->elem);
+			free (r);
+			fe->run_cnt--;
+		}
+	} else {
+		r->cnt = start - r->start;
+		if (end < r_end) {
+			struct free_run *tail = malloc (sizeof *tail);
+
+			/* Without memory the tail is forgotten, as in
+			 * free_extents_add(). */
+			if (tail == NULL) {
+				fe->free_cnt -= r_end - end;
+				return;
+			}
+			tail->start = end;
+			tail->cnt = r_end - end;
+			list_insert (list_next (&r->elem), &tail->elem);
+			fe->run_cnt++;
+		}
+	}
+}
+
+/* Returns the run holding block HINT, or a null pointer. */
+static struct free_run *
+run_at (struct free_extents *fe, uint32_t hint) {
+	struct list_elem *e;
+
+	for (e = list_begin (&fe->runs); e != list_end (&fe->runs);
+			e = list_next (e)) {
+		struct free_run *r = list_entry (e, struct free_run, elem);
+		if (r->start > hint)
+			break;
+		if (hint < r->start + r->cnt)
+			return r;
+	}
+	return NULL;
+}
+
+/* Allocates CNT consecutive blocks from FE, at HINT if they are free
+ * there and otherwise from the smallest run that fits, and stores the
+ * first into *STARTP.  Returns false if no run is large enough. */
+bool
+free_extents_alloc (struct free_extents *fe, size_t cnt, uint32_t hint,
+		uint32_t *startp) {
+	struct free_run *r = run_at (fe, hint), *best = NULL;
+	struct list_elem *e;
+
+	ASSERT (cnt > 0);
+
+	if (r != NULL && hint + cnt <= r->start + r->cnt) {
+		run_take (fe, r, hint, cnt);
+		*startp = hint;
+		return true;
+	}
+
+	for (e = list_begin (&fe->runs); e != list_end (&fe->runs);
+			e = list_next (e)) {
+		r = list_entry (e, struct free_run, elem);
+		if (r->cnt >= cnt && (best == NULL || r->cnt < best->cnt)) {
+			best = r;
+			if (r->cnt == cnt)
+				break;
+		}
+	}
+	if (best == NULL)
+		return false;
+	*startp = best->start;
+	run_take (fe, best, best->start, cnt);
+	return true;
+}
+
+/* Allocates up to CNT consecutive blocks from FE and stores the
+ * first into *STARTP.  Takes all CNT as free_extents_alloc() would if
+ * it can, else as many as are free from HINT on, else the start of
+ * the largest run.  Returns how many were taken, 0 if FE is empty. */
+size_t
+free_extents_alloc_some (struct free_extents *fe, size_t cnt,
+		uint32_t hint, uint32_t *startp) {
+	struct free_run *largest = NULL, *r;
+	struct list_elem *e;
+
+	if (cnt == 0)
+		return 0;
+	if (free_extents_alloc (fe, cnt, hint, startp))
+		return cnt;
+
+	r = run_at (fe, hint);
+	if (r != NULL) {
+		cnt = r->start + r->cnt - hint;
+		*startp = hint;
+		run_take (fe, r, hint, cnt);
+		return cnt;
+	}
+
+	for (e = list_begin (&fe->runs); e != list_end (&fe->runs);
+			e = list_next (e)) {
+		struct free_run *r = list_entry (e, struct free_run, elem);
+		if (largest == NULL || r->cnt > largest->cnt)
+			largest = r;
+	}
+	if (largest == NULL)
+		return 0;
+	cnt = largest->cnt;
+	*startp = largest->start;
+	run_take (fe, largest, largest->start, cnt);
+	return cnt;
+}
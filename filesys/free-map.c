@@ -3,10 +3,33 @@
 #include <debug.h>
 #include "filesys/file.h"
 #include "filesys/filesys.h"
+#include "filesys/free-extent.h"
 #include "filesys/inode.h"
+#include "filesys/journal.h"
+#include "threads/synch.h"
 
 static struct file *free_map_file;   /* Free map file. */
 static struct bitmap *free_map;      /* Free map, one bit per disk sector. */
+static struct free_extents free_runs; /* Free sectors, as runs. */
+static struct lock free_map_lock;
+
+/* Rebuilds free_runs from free_map. */
+static void
+free_map_build_runs (void) {
+	size_t i, cnt = bitmap_size (free_map);
+
+	free_extents_clear (&free_runs);
+	for (i = 0; i < cnt; ) {
+		size_t end = bitmap_scan (free_map, i, 1, false);
+		if (end == BITMAP_ERROR)
+			break;
+		i = end;
+		while (end < cnt && !bitmap_test (free_map, end))
+			end++;
+		free_extents_add (&free_runs, i, end - i);
+		i = end;
+	}
+}
 
 /* Initializes the free map. */
 void
@@ -16,32 +39,64 @@ free_map_init (void) {
 		PANIC ("bitmap creation failed--disk is too large");
 	bitmap_mark (free_map, FREE_MAP_SECTOR);
 	bitmap_mark (free_map, ROOT_DIR_SECTOR);
+	bitmap_set_multiple (free_map, JOURNAL_SECTOR, JOURNAL_SECTORS, true);
+	lock_init (&free_map_lock);
+	free_extents_init (&free_runs);
+	free_map_build_runs ();
 }
 
 /* Allocates CNT consecutive sectors from the free map and stores
- * the first into *SECTORP.
+ * the first into *SECTORP.  They start at HINT if they are free there,
+ * and otherwise come from the smallest free run that fits.
  * Returns true if successful, false if all sectors were
  * available. */
 bool
-free_map_allocate (size_t cnt, disk_sector_t *sectorp) {
-	disk_sector_t sector = bitmap_scan_and_flip (free_map, 0, cnt, false);
-	if (sector != BITMAP_ERROR
-			&& free_map_file != NULL
-			&& !bitmap_write (free_map, free_map_file)) {
-		bitmap_set_multiple (free_map, sector, cnt, false);
-		sector = BITMAP_ERROR;
+free_map_allocate_near (disk_sector_t hint, size_t cnt,
+		disk_sector_t *sectorp) {
+	uint32_t sector;
+	bool success;
+
+	if (cnt == 0) {
+		*sectorp = 0;
+		return true;
+	}
+
+	lock_acquire (&free_map_lock);
+	success = free_extents_alloc (&free_runs, cnt, hint, &sector);
+	if (success) {
+		ASSERT (!bitmap_any (free_map, sector, cnt));
+		bitmap_set_multiple (free_map, sector, cnt, true);
+		if (free_map_file != NULL && !bitmap_write (free_map, free_map_file)) {
+			bitmap_set_multiple (free_map, sector, cnt, false);
+			free_extents_add (&free_runs, sector, cnt);
+			success = false;
+		}
 	}
-	if (sector != BITMAP_ERROR)
+	lock_release (&free_map_lock);
+
+	if (success)
 		*sectorp = sector;
-	return sector != BITMAP_ERROR;
+	return success;
+}
+
+/* Allocates CNT consecutive sectors from the free map, wherever they
+ * fit best, and stores the first into *SECTORP.
+ * Returns true if successful, false if all sectors were
+ * available. */
+bool
+free_map_allocate (size_t cnt, disk_sector_t *sectorp) {
+	return free_map_allocate_near (0, cnt, sectorp);
 }
 
 /* Makes CNT sectors starting at SECTOR available for use. */
 void
 free_map_release (disk_sector_t sector, size_t cnt) {
+	lock_acquire (&free_map_lock);
 	ASSERT (bitmap_all (free_map, sector, cnt));
 	bitmap_set_multiple (free_map, sector, cnt, false);
+	free_extents_add (&free_runs, sector, cnt);
 	bitmap_write (free_map, free_map_file);
+	lock_release (&free_map_lock);
 }
 
 /* Opens the free map file and reads it from disk. */
@@ -50,8 +105,10 @@ free_map_open (void) {
 	free_map_file = file_open (inode_open (FREE_MAP_SECTOR));
 	if (free_map_file == NULL)
 		PANIC ("can't open free map");
+	inode_set_meta (file_get_inode (free_map_file));
 	if (!bitmap_read (free_map, free_map_file))
 		PANIC ("can't read free map");
+	free_map_build_runs ();
 }
 
 /* Writes the free map to disk and closes the free map file. */
@@ -72,6 +129,7 @@ free_map_create (void) {
 	free_map_file = file_open (inode_open (FREE_MAP_SECTOR));
 	if (free_map_file == NULL)
 		PANIC ("can't open free map");
+	inode_set_meta (file_get_inode (free_map_file));
 	if (!bitmap_write (free_map, free_map_file))
 		PANIC ("can't write free map");
 }
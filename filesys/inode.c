@@ -1,11 +1,19 @@
 #include "filesys/inode.h"
+#include <hash.h>
+#include <inttypes.h>
 #include <list.h>
 #include <debug.h>
+#include <stdio.h>
 #include <round.h>
 #include <string.h>
+#include "filesys/buffer_cache.h"
+#include "filesys/fat.h"
 #include "filesys/filesys.h"
 #include "filesys/free-map.h"
+#include "filesys/journal.h"
+#include "filesys/page_cache.h"
 #include "threads/malloc.h"
+#include "threads/synch.h"
 
 /* Identifies an inode. */
 #define INODE_MAGIC 0x494e4f44
@@ -13,7 +21,8 @@
 /* On-disk inode.
  * Must be exactly DISK_SECTOR_SIZE bytes long. */
 struct inode_disk {
-	disk_sector_t start;                /* First data sector. */
+	disk_sector_t start;                /* First data sector, or first
+	                                       cluster with EFILESYS. */
 	off_t length;                       /* File size in bytes. */
 	unsigned magic;                     /* Magic number. */
 	uint32_t unused[125];               /* Not used. */
@@ -28,14 +37,308 @@ bytes_to_sectors (off_t size) {
 
 /* In-memory inode. */
 struct inode {
-	struct list_elem elem;              /* Element in inode list. */
+	struct hash_elem elem;              /* Element in inode table. */
+	struct list_elem lru_elem;          /* In unused_inodes if unopened. */
 	disk_sector_t sector;               /* Sector number of disk location. */
 	int open_cnt;                       /* Number of openers. */
+	unsigned close_cnt;                 /* Number of closes so far. */
 	bool removed;                       /* True if deleted, false otherwise. */
 	int deny_write_cnt;                 /* 0: writes ok, >0: deny writes. */
+	bool meta;                          /* Contents are journaled. */
 	struct inode_disk data;             /* Inode content. */
+#ifdef EFILESYS
+	/* Extent cache: the first EXT_CLUSTERS clusters of the chain, as
+	 * runs of consecutive clusters sorted by file cluster index. */
+	struct lock ext_lock;
+	struct extent *ext;
+	size_t ext_cnt, ext_cap;
+	uint32_t ext_clusters;
+
+	/* Delayed allocation: sectors written past the end of the chain
+	 * stay in memory, on DELALLOC by index, until writeback gives
+	 * them clusters all at once. */
+	struct lock da_lock;
+	struct list delalloc;
+	size_t da_cnt;
+	uint32_t chain_len;                 /* Clusters in the chain. */
+	bool grown;                         /* Length changed since written. */
+#endif
+#ifdef VM
+	struct list cached_pages;           /* Its pages in the page cache. */
+#endif
 };
 
+#ifdef EFILESYS
+#define CLUSTER_SIZE (SECTORS_PER_CLUSTER * DISK_SECTOR_SIZE)
+
+/* Run of LEN clusters of a file, starting at file cluster index IDX,
+ * that sit at consecutive clusters starting at CLST. */
+struct extent {
+	uint32_t idx;
+	cluster_t clst;
+	uint32_t len;
+};
+
+/* Records that file cluster IDX of INODE, the one right after the
+ * cached ones, is cluster CLST.  Returns false if out of memory. */
+static bool
+extent_append (struct inode *inode, uint32_t idx, cluster_t clst) {
+	struct extent *last = inode->ext_cnt > 0
+		? &inode->ext[inode->ext_cnt - 1] : NULL;
+
+	ASSERT (idx == inode->ext_clusters);
+
+	if (last != NULL && last->clst + last->len == clst)
+		last->len++;
+	else {
+		if (inode->ext_cnt == inode->ext_cap) {
+			size_t cap = inode->ext_cap > 0 ? inode->ext_cap * 2 : 4;
+			struct extent *ext = realloc (inode->ext, cap * sizeof *ext);
+			if (ext == NULL)
+				return false;
+			inode->ext = ext;
+			inode->ext_cap = cap;
+		}
+		inode->ext[inode->ext_cnt++] = (struct extent) {idx, clst, 1};
+	}
+	inode->ext_clusters++;
+	return true;
+}
+
+/* Forgets INODE's cached extents, after its chain was freed. */
+static void
+extent_clear (struct inode *inode) {
+	free (inode->ext);
+	inode->ext = NULL;
+	inode->ext_cnt = inode->ext_cap = 0;
+	inode->ext_clusters = 0;
+}
+
+/* Returns the cluster holding file cluster IDX of INODE.  A cached
+ * index is found by binary search over the extents; anything past
+ * them is found by following the chain from the last cached cluster,
+ * caching what it walks over, so each FAT entry is read once. */
+static cluster_t
+inode_cluster (struct inode *inode, uint32_t idx) {
+	cluster_t clst;
+	uint32_t i;
+
+	lock_acquire (&inode->ext_lock);
+	if (idx < inode->ext_clusters) {
+		size_t lo = 0, hi = inode->ext_cnt;
+
+		while (hi - lo > 1) {
+			size_t mid = (lo + hi) / 2;
+			if (inode->ext[mid].idx <= idx)
+				lo = mid;
+			else
+				hi = mid;
+		}
+		clst = inode->ext[lo].clst + (idx - inode->ext[lo].idx);
+		lock_release (&inode->ext_lock);
+		return clst;
+	}
+
+	if (inode->ext_clusters == 0) {
+		i = 0;
+		clst = inode->data.start;
+		if (clst == 0)
+			goto done;
+		extent_append (inode, 0, clst);
+	} else {
+		struct extent *last = &inode->ext[inode->ext_cnt - 1];
+		i = inode->ext_clusters - 1;
+		clst = last->clst + last->len - 1;
+	}
+
+	/* Once out of memory, keep walking without caching. */
+	for (; i < idx; i++) {
+		clst = fat_get (clst);
+		if (clst == 0 || clst == EOChain) {
+			clst = 0;
+			break;
+		}
+		if (i + 1 == inode->ext_clusters)
+			extent_append (inode, i + 1, clst);
+	}
+done:
+	lock_release (&inode->ext_lock);
+	return clst;
+}
+
+/* Returns the disk sector that contains byte offset POS within
+ * INODE.
+ * Returns -1 if INODE does not contain data for a byte at offset
+ * POS. */
+static disk_sector_t
+byte_to_sector (struct inode *inode, off_t pos) {
+	cluster_t clst;
+
+	ASSERT (inode != NULL);
+	if (pos >= inode->data.length
+			|| (uint32_t) (pos / CLUSTER_SIZE) >= inode->chain_len)
+		return -1;
+	clst = inode_cluster (inode, pos / CLUSTER_SIZE);
+	if (clst == 0)
+		return -1;
+	return cluster_to_sector (clst) + pos % CLUSTER_SIZE / DISK_SECTOR_SIZE;
+}
+
+/* Most delayed sectors kept per inode before writing back. */
+#define DELALLOC_MAX 64
+
+/* Sector of file data written past the end of the chain, not yet
+ * given a cluster. */
+struct da_block {
+	struct list_elem elem;              /* Element in inode's delalloc. */
+	uint32_t idx;                       /* Sector index within the file. */
+	uint8_t data[DISK_SECTOR_SIZE];
+};
+
+/* Statistics. */
+static uint64_t da_writeback_cnt;       /* Writebacks that allocated. */
+static uint64_t da_sector_cnt;          /* Sectors allocated by them. */
+static uint64_t da_drop_cnt;            /* Sectors dropped with files. */
+
+/* Returns INODE's delayed sector IDX, or a new zeroed one if CREATE
+ * and there is none.  Returns a null pointer if there is none and
+ * CREATE is false or memory runs out. */
+static struct da_block *
+da_find (struct inode *inode, uint32_t idx, bool create) {
+	struct list_elem *e;
+	struct da_block *b;
+
+	ASSERT (lock_held_by_current_thread (&inode->da_lock));
+
+	for (e = list_begin (&inode->delalloc); e != list_end (&inode->delalloc);
+			e = list_next (e)) {
+		b = list_entry (e, struct da_block, elem);
+		if (b->idx == idx)
+			return b;
+		if (b->idx > idx)
+			break;
+	}
+	if (!create)
+		return NULL;
+	b = calloc (1, sizeof *b);
+	if (b == NULL)
+		return NULL;
+	b->idx = idx;
+	list_insert (e, &b->elem);
+	inode->da_cnt++;
+	return b;
+}
+
+/* Reads SIZE bytes at OFS of INODE's sector IDX, past the chain as
+ * byte_to_sector() saw it, into BUFFER.  A sector never written
+ * reads as zeros. */
+static void
+delalloc_read (struct inode *inode, uint32_t idx, void *buffer, int ofs,
+		int size) {
+	struct da_block *b;
+
+	lock_acquire (&inode->da_lock);
+	if (idx < inode->chain_len)
+		buffer_cache_read (cluster_to_sector (inode_cluster (inode, idx)),
+				buffer, ofs, size);
+	else if ((b = da_find (inode, idx, false)) != NULL)
+		memcpy (buffer, b->data + ofs, size);
+	else
+		memset (buffer, 0, size);
+	lock_release (&inode->da_lock);
+}
+
+/* Writes SIZE bytes from BUFFER at OFS of INODE's sector IDX, past
+ * the chain as byte_to_sector() saw it, keeping them in memory.
+ * Returns false if out of memory. */
+static bool
+delalloc_write (struct inode *inode, uint32_t idx, const void *buffer,
+		int ofs, int size) {
+	struct da_block *b;
+	bool success = true;
+
+	lock_acquire (&inode->da_lock);
+	if (idx < inode->chain_len)
+		buffer_cache_write (cluster_to_sector (inode_cluster (inode, idx)),
+				buffer, ofs, size);
+	else if ((b = da_find (inode, idx, true)) != NULL)
+		memcpy (b->data + ofs, buffer, size);
+	else
+		success = false;
+	lock_release (&inode->da_lock);
+	return success;
+}
+
+/* Gives INODE's delayed sectors clusters, as one run right after the
+ * chain's last cluster if it is free, writes them to the buffer
+ * cache, and writes the inode if its length changed.  Sectors
+ * skipped over by writes are allocated too, as zeros.  Returns false,
+ * keeping the sectors in memory, if the disk is full. */
+static bool
+inode_writeback (struct inode *inode) {
+	static char zeros[DISK_SECTOR_SIZE];
+	uint32_t first, last, i;
+	cluster_t prev, clst;
+
+	lock_acquire (&inode->da_lock);
+	if (!list_empty (&inode->delalloc)) {
+		first = inode->chain_len;
+		last = list_entry (list_back (&inode->delalloc),
+				struct da_block, elem)->idx;
+		prev = first > 0 ? inode_cluster (inode, first - 1) : 0;
+		clst = fat_extend_chain (prev, last - first + 1, prev != 0
+				? prev + 1 : sector_to_cluster (inode->sector) + 1);
+		if (clst == 0) {
+			lock_release (&inode->da_lock);
+			return false;
+		}
+		if (inode->data.start == 0)
+			inode->data.start = clst;
+
+		for (i = first; i <= last; i++) {
+			struct da_block *b = list_entry (list_front (&inode->delalloc),
+					struct da_block, elem);
+
+			if (b->idx == i) {
+				list_pop_front (&inode->delalloc);
+				buffer_cache_write (cluster_to_sector (clst), b->data, 0,
+						DISK_SECTOR_SIZE);
+				free (b);
+			} else
+				buffer_cache_write (cluster_to_sector (clst), zeros, 0,
+						DISK_SECTOR_SIZE);
+			lock_acquire (&inode->ext_lock);
+			if (inode->ext_clusters == i)
+				extent_append (inode, i, clst);
+			lock_release (&inode->ext_lock);
+			clst = fat_get (clst);
+		}
+		inode->chain_len = last + 1;
+		inode->da_cnt = 0;
+		da_writeback_cnt++;
+		da_sector_cnt += last - first + 1;
+	}
+	if (inode->grown) {
+		buffer_cache_write_meta (inode->sector, &inode->data, 0,
+				DISK_SECTOR_SIZE);
+		inode->grown = false;
+	}
+	lock_release (&inode->da_lock);
+	return true;
+}
+
+/* Drops the delayed sectors of INODE, which is being freed, so that
+ * those of a removed file never reach the allocator or the disk. */
+static void
+delalloc_drop (struct inode *inode) {
+	while (!list_empty (&inode->delalloc)) {
+		free (list_entry (list_pop_front (&inode->delalloc),
+					struct da_block, elem));
+		da_drop_cnt++;
+	}
+	inode->da_cnt = 0;
+}
+#else
 /* Returns the disk sector that contains byte offset POS within
  * INODE.
  * Returns -1 if INODE does not contain data for a byte at offset
@@ -48,15 +351,68 @@ byte_to_sector (const struct inode *inode, off_t pos) {
 	else
 		return -1;
 }
+#endif
+
+/* Returns the disk sector that holds byte offset POS within INODE,
+ * or -1 if INODE does not contain data for a byte at offset POS.
+ * Lets the swap code write a swap file's sectors directly. */
+disk_sector_t
+inode_get_sector (struct inode *inode, off_t pos) {
+	return byte_to_sector (inode, pos);
+}
 
-/* List of open inodes, so that opening a single inode twice
- * returns the same `struct inode'. */
-static struct list open_inodes;
+/* Most inodes kept in memory after their last close. */
+#define INODE_UNUSED_MAX 32
+
+/* Table of in-memory inodes by sector, so that opening a single
+ * inode twice returns the same `struct inode'.  Besides the open
+ * ones, it holds up to INODE_UNUSED_MAX inodes nobody has open, on
+ * unused_inodes with the most recently closed at the front, so that
+ * opening one of them again needs no disk read.  Growth is written
+ * back at the last close, so these never need writing. */
+static struct hash inodes;
+static struct list unused_inodes;
+static size_t unused_cnt;
+static struct lock inodes_lock;
+
+/* Statistics. */
+static uint64_t inode_open_hit_cnt;     /* Opens of an open inode. */
+static uint64_t inode_revive_cnt;       /* Opens of an unused inode. */
+static uint64_t inode_read_cnt;         /* Opens that read the disk. */
+
+static uint64_t
+inode_hash (const struct hash_elem *e, void *aux UNUSED) {
+	const struct inode *inode = hash_entry (e, struct inode, elem);
+	return hash_int (inode->sector);
+}
+
+static bool
+inode_less (const struct hash_elem *a, const struct hash_elem *b,
+		void *aux UNUSED) {
+	return hash_entry (a, struct inode, elem)->sector
+		< hash_entry (b, struct inode, elem)->sector;
+}
 
 /* Initializes the inode module. */
 void
 inode_init (void) {
-	list_init (&open_inodes);
+	if (!hash_init (&inodes, inode_hash, inode_less, NULL))
+		PANIC ("inode table: out of memory");
+	list_init (&unused_inodes);
+	lock_init (&inodes_lock);
+}
+
+/* Frees INODE, which is unopened and out of the table. */
+static void
+inode_free (struct inode *inode) {
+#ifdef VM
+	page_cache_drop (inode);
+#endif
+#ifdef EFILESYS
+	delalloc_drop (inode);
+	extent_clear (inode);
+#endif
+	free (inode);
 }
 
 /* Initializes an inode with LENGTH bytes of data and
@@ -80,17 +436,41 @@ inode_create (disk_sector_t sector, off_t length) {
 		size_t sectors = bytes_to_sectors (length);
 		disk_inode->length = length;
 		disk_inode->magic = INODE_MAGIC;
-		if (free_map_allocate (sectors, &disk_inode->start)) {
-			disk_write (filesys_disk, sector, disk_inode);
+#ifdef EFILESYS
+		/* Chain one cluster per sector, right after the inode if there
+		 * is room, and zero each. */
+		static char zeros[DISK_SECTOR_SIZE];
+		cluster_t clst = 0;
+		size_t i;
+
+		ASSERT (SECTORS_PER_CLUSTER == 1);
+		if (sectors > 0)
+			clst = fat_extend_chain (0, sectors, sector_to_cluster (sector) + 1);
+		success = sectors == 0 || clst != 0;
+		if (success) {
+			disk_inode->start = clst;
+			for (i = 0; i < sectors; i++) {
+				buffer_cache_write (cluster_to_sector (clst), zeros, 0,
+						DISK_SECTOR_SIZE);
+				clst = fat_get (clst);
+			}
+			buffer_cache_write_meta (sector, disk_inode, 0, DISK_SECTOR_SIZE);
+		}
+#else
+		/* Put the data right after the inode if there is room. */
+		if (free_map_allocate_near (sector + 1, sectors, &disk_inode->start)) {
+			buffer_cache_write_meta (sector, disk_inode, 0, DISK_SECTOR_SIZE);
 			if (sectors > 0) {
 				static char zeros[DISK_SECTOR_SIZE];
 				size_t i;
 
 				for (i = 0; i < sectors; i++) 
-					disk_write (filesys_disk, disk_inode->start + i, zeros); 
+					buffer_cache_write (disk_inode->start + i, zeros, 0,
+							DISK_SECTOR_SIZE); 
 			}
 			success = true; 
 		} 
+#endif
 		free (disk_inode);
 	}
 	return success;
@@ -101,39 +481,72 @@ inode_create (disk_sector_t sector, off_t length) {
  * Returns a null pointer if memory allocation fails. */
 struct inode *
 inode_open (disk_sector_t sector) {
-	struct list_elem *e;
+	struct inode key;
+	struct hash_elem *e;
 	struct inode *inode;
 
-	/* Check whether this inode is already open. */
-	for (e = list_begin (&open_inodes); e != list_end (&open_inodes);
-			e = list_next (e)) {
-		inode = list_entry (e, struct inode, elem);
-		if (inode->sector == sector) {
-			inode_reopen (inode);
-			return inode; 
-		}
+	lock_acquire (&inodes_lock);
+
+	/* Check whether this inode is in memory already. */
+	key.sector = sector;
+	e = hash_find (&inodes, &key.elem);
+	if (e != NULL) {
+		inode = hash_entry (e, struct inode, elem);
+		if (inode->open_cnt++ == 0) {
+			list_remove (&inode->lru_elem);
+			unused_cnt--;
+			inode_revive_cnt++;
+		} else
+			inode_open_hit_cnt++;
+		lock_release (&inodes_lock);
+		return inode; 
 	}
 
 	/* Allocate memory. */
 	inode = malloc (sizeof *inode);
-	if (inode == NULL)
+	if (inode == NULL) {
+		lock_release (&inodes_lock);
 		return NULL;
+	}
 
 	/* Initialize. */
-	list_push_front (&open_inodes, &inode->elem);
 	inode->sector = sector;
+	hash_insert (&inodes, &inode->elem);
 	inode->open_cnt = 1;
+	inode->close_cnt = 0;
 	inode->deny_write_cnt = 0;
 	inode->removed = false;
-	disk_read (filesys_disk, inode->sector, &inode->data);
+	inode->meta = false;
+#ifdef EFILESYS
+	lock_init (&inode->ext_lock);
+	inode->ext = NULL;
+	inode->ext_cnt = inode->ext_cap = 0;
+	inode->ext_clusters = 0;
+	lock_init (&inode->da_lock);
+	list_init (&inode->delalloc);
+	inode->da_cnt = 0;
+	inode->grown = false;
+#endif
+#ifdef VM
+	list_init (&inode->cached_pages);
+#endif
+	buffer_cache_read (inode->sector, &inode->data, 0, DISK_SECTOR_SIZE);
+#ifdef EFILESYS
+	inode->chain_len = bytes_to_sectors (inode->data.length);
+#endif
+	inode_read_cnt++;
+	lock_release (&inodes_lock);
 	return inode;
 }
 
 /* Reopens and returns INODE. */
 struct inode *
 inode_reopen (struct inode *inode) {
-	if (inode != NULL)
+	if (inode != NULL) {
+		lock_acquire (&inodes_lock);
 		inode->open_cnt++;
+		lock_release (&inodes_lock);
+	}
 	return inode;
 }
 
@@ -143,29 +556,94 @@ inode_get_inumber (const struct inode *inode) {
 	return inode->sector;
 }
 
-/* Closes INODE and writes it to disk.
- * If this was the last reference to INODE, frees its memory.
- * If INODE was also a removed inode, frees its blocks. */
+/* Writes back INODE's cached pages and growth.  Metadata bypasses
+ * the page cache. */
+static void
+inode_sync (struct inode *inode UNUSED) {
+#ifdef VM
+	if (!inode->meta)
+		page_cache_flush (inode);
+#endif
+#ifdef EFILESYS
+	inode_writeback (inode);
+#endif
+}
+
+/* Closes INODE.
+ * If this was the last reference to INODE, writes back its cached
+ * pages and growth and keeps it among the unused inodes, dropping the least recently
+ * closed one if there are too many.
+ * If INODE was also a removed inode, frees its blocks and memory. */
 void
 inode_close (struct inode *inode) {
+	bool handle = false;
+	bool synced = false;
+	unsigned seen = 0;
+
 	/* Ignore null pointer. */
 	if (inode == NULL)
 		return;
 
+	/* The last opener writes back and frees blocks without holding
+	 * inodes_lock, still counted as an opener so that INODE stays in
+	 * memory: both take journal handles, and a journal commit waits
+	 * for threads that hold a handle while waiting on inodes_lock in
+	 * inode_open().  Writing back is repeated if someone else closed
+	 * INODE meanwhile, since they may have written to it. */
+	lock_acquire (&inodes_lock);
+	while (inode->open_cnt == 1) {
+		if (inode->removed && !handle) {
+			/* Freeing a removed inode's blocks is one operation.  Its
+			 * pages go first, waiting for writes already under way,
+			 * which may need a journal handle themselves. */
+			lock_release (&inodes_lock);
+#ifdef VM
+			page_cache_drop (inode);
+#endif
+			journal_start ();
+			handle = true;
+		} else if (!inode->removed
+				&& (!synced || inode->close_cnt != seen)) {
+			seen = inode->close_cnt;
+			synced = true;
+			lock_release (&inodes_lock);
+			inode_sync (inode);
+		} else
+			break;
+		lock_acquire (&inodes_lock);
+	}
+	inode->close_cnt++;
+
 	/* Release resources if this was the last opener. */
 	if (--inode->open_cnt == 0) {
-		/* Remove from inode list and release lock. */
-		list_remove (&inode->elem);
-
-		/* Deallocate blocks if removed. */
-		if (inode->removed) {
+		if (!inode->removed) {
+			list_push_front (&unused_inodes, &inode->lru_elem);
+			if (++unused_cnt > INODE_UNUSED_MAX) {
+				struct inode *victim = list_entry (list_pop_back (&unused_inodes),
+						struct inode, lru_elem);
+				unused_cnt--;
+				hash_delete (&inodes, &victim->elem);
+				inode_free (victim);
+			}
+		} else {
+			/* Remove from inode table and deallocate blocks. */
+			hash_delete (&inodes, &inode->elem);
+#ifdef EFILESYS
+			fat_remove_chain (sector_to_cluster (inode->sector), 0);
+			if (inode->data.start != 0)
+				fat_remove_chain (inode->data.start, 0);
+#else
 			free_map_release (inode->sector, 1);
 			free_map_release (inode->data.start,
 					bytes_to_sectors (inode->data.length)); 
+#endif
+			inode_free (inode);
 		}
-
-		free (inode); 
 	}
+
+	lock_release (&inodes_lock);
+	if (handle)
+		journal_stop ();
 }
 
 /* Marks INODE to be deleted when it is closed by the last caller who
@@ -178,12 +656,24 @@ inode_remove (struct inode *inode) {
 
 /* Reads SIZE bytes from INODE into BUFFER, starting at position OFFSET.
  * Returns the number of bytes actually read, which may be less
- * than SIZE if an error occurs or end of file is reached. */
+ * than SIZE if an error occurs or end of file is reached.
+ * File data goes through the page cache once there is one. */
+off_t
+inode_read_at (struct inode *inode, void *buffer, off_t size, off_t offset) {
+#ifdef VM
+	if (page_cache_enabled && !inode->meta)
+		return page_cache_read (inode, buffer, size, offset);
+#endif
+	return inode_read_direct (inode, buffer, size, offset);
+}
+
+/* Like inode_read_at(), but bypasses the page cache, for the page
+ * cache itself and for metadata. */
 off_t
-inode_read_at (struct inode *inode, void *buffer_, off_t size, off_t offset) {
+inode_read_direct (struct inode *inode, void *buffer_, off_t size,
+		off_t offset) {
 	uint8_t *buffer = buffer_;
 	off_t bytes_read = 0;
-	uint8_t *bounce = NULL;
 
 	while (size > 0) {
 		/* Disk sector to read, starting byte offset within sector. */
@@ -200,46 +690,83 @@ inode_read_at (struct inode *inode, void *buffer_, off_t size, off_t offset) {
 		if (chunk_size <= 0)
 			break;
 
-		if (sector_ofs == 0 && chunk_size == DISK_SECTOR_SIZE) {
-			/* Read full sector directly into caller's buffer. */
-			disk_read (filesys_disk, sector_idx, buffer + bytes_read); 
-		} else {
-			/* Read sector into bounce buffer, then partially copy
-			 * into caller's buffer. */
-			if (bounce == NULL) {
-				bounce = malloc (DISK_SECTOR_SIZE);
-				if (bounce == NULL)
-					break;
-			}
-			disk_read (filesys_disk, sector_idx, bounce);
-			memcpy (buffer + bytes_read, bounce + sector_ofs, chunk_size);
-		}
+#ifdef EFILESYS
+		if (sector_idx == (disk_sector_t) -1)
+			delalloc_read (inode, offset / DISK_SECTOR_SIZE, buffer + bytes_read,
+					sector_ofs, chunk_size);
+		else
+#endif
+		buffer_cache_read (sector_idx, buffer + bytes_read, sector_ofs,
+				chunk_size);
 
 		/* Advance. */
 		size -= chunk_size;
 		offset += chunk_size;
 		bytes_read += chunk_size;
 	}
-	free (bounce);
 
 	return bytes_read;
 }
 
+/* Starts loading the sectors holding SIZE bytes of INODE from OFFSET
+ * into the buffer cache, without waiting for them.  Stops at end of
+ * file. */
+void
+inode_readahead (struct inode *inode, off_t size, off_t offset) {
+	off_t end = offset + size;
+
+	if (end > inode_length (inode))
+		end = inode_length (inode);
+	offset = ROUND_DOWN (offset, DISK_SECTOR_SIZE);
+	for (; offset < end; offset += DISK_SECTOR_SIZE) {
+		disk_sector_t sector = byte_to_sector (inode, offset);
+
+		/* Delayed sectors are in memory already. */
+		if (sector == (disk_sector_t) -1)
+			break;
+		buffer_cache_readahead (sector);
+	}
+}
+
 /* Writes SIZE bytes from BUFFER into INODE, starting at OFFSET.
  * Returns the number of bytes actually written, which may be
  * less than SIZE if end of file is reached or an error occurs.
- * (Normally a write at end of file would extend the inode, but
- * growth is not yet implemented.) */
+ * With EFILESYS, a write past end of file extends the inode, except
+ * for metadata; the new sectors get clusters only at writeback.
+ * File data goes through the page cache once there is one. */
 off_t
-inode_write_at (struct inode *inode, const void *buffer_, off_t size,
+inode_write_at (struct inode *inode, const void *buffer, off_t size,
 		off_t offset) {
-	const uint8_t *buffer = buffer_;
-	off_t bytes_written = 0;
-	uint8_t *bounce = NULL;
-
 	if (inode->deny_write_cnt)
 		return 0;
 
+#ifdef EFILESYS
+	if (!inode->meta && size > 0 && offset + size > inode_length (inode)) {
+		lock_acquire (&inode->da_lock);
+		if (offset + size > inode->data.length) {
+			inode->data.length = offset + size;
+			inode->grown = true;
+		}
+		lock_release (&inode->da_lock);
+	}
+#endif
+
+#ifdef VM
+	if (page_cache_enabled && !inode->meta)
+		return page_cache_write (inode, buffer, size, offset);
+#endif
+	return inode_write_direct (inode, buffer, size, offset);
+}
+
+/* Like inode_write_at(), but bypasses the page cache and neither
+ * extends INODE nor checks for denied writes, for the page cache
+ * itself and for metadata. */
+off_t
+inode_write_direct (struct inode *inode, const void *buffer_, off_t size,
+		off_t offset) {
+	const uint8_t *buffer = buffer_;
+	off_t bytes_written = 0;
+
 	while (size > 0) {
 		/* Sector to write, starting byte offset within sector. */
 		disk_sector_t sector_idx = byte_to_sector (inode, offset);
@@ -255,35 +782,34 @@ inode_write_at (struct inode *inode, const void *buffer_, off_t size,
 		if (chunk_size <= 0)
 			break;
 
-		if (sector_ofs == 0 && chunk_size == DISK_SECTOR_SIZE) {
-			/* Write full sector directly to disk. */
-			disk_write (filesys_disk, sector_idx, buffer + bytes_written); 
-		} else {
-			/* We need a bounce buffer. */
-			if (bounce == NULL) {
-				bounce = malloc (DISK_SECTOR_SIZE);
-				if (bounce == NULL)
-					break;
-			}
-
-			/* If the sector contains data before or after the chunk
-			   we're writing, then we need to read in the sector
-			   first.  Otherwise we start with a sector of all zeros. */
-			if (sector_ofs > 0 || chunk_size < sector_left) 
-				disk_read (filesys_disk, sector_idx, bounce);
-			else
-				memset (bounce, 0, DISK_SECTOR_SIZE);
-			memcpy (bounce + sector_ofs, buffer + bytes_written, chunk_size);
-			disk_write (filesys_disk, sector_idx, bounce); 
-		}
+		/* A whole sector is overwritten in the cache without being
+		 * read first. */
+#ifdef EFILESYS
+		if (sector_idx == (disk_sector_t) -1) {
+			if (!delalloc_write (inode, offset / DISK_SECTOR_SIZE,
+						buffer + bytes_written, sector_ofs, chunk_size))
+				break;
+		} else
+#endif
+		if (inode->meta)
+			buffer_cache_write_meta (sector_idx, buffer + bytes_written,
+					sector_ofs, chunk_size);
+		else
+			buffer_cache_write (sector_idx, buffer + bytes_written, sector_ofs,
+					chunk_size);
 
 		/* Advance. */
 		size -= chunk_size;
 		offset += chunk_size;
 		bytes_written += chunk_size;
 	}
-	free (bounce);
 
+#ifdef EFILESYS
+	/* The page cache may write back a file that was removed already,
+	 * whose data never needs a cluster. */
+	if (inode->da_cnt >= DELALLOC_MAX && !inode->removed)
+		inode_writeback (inode);
+#endif
 	return bytes_written;
 }
 
@@ -306,6 +832,68 @@ inode_allow_write (struct inode *inode) {
 	inode->deny_write_cnt--;
 }
 
+/* Marks INODE as metadata, such as a directory, whose writes go
+ * through the journal. */
+void
+inode_set_meta (struct inode *inode) {
+	inode->meta = true;
+}
+
+void
+inode_print_stats (void) {
+	uint64_t total = inode_open_hit_cnt + inode_revive_cnt + inode_read_cnt;
+
+	printf ("Inodes: %"PRIu64" opens, %"PRIu64" already open, %"PRIu64" "
+			"revived without reading (%"PRIu64"%% hit rate), %zu unused "
+			"kept\n", total, inode_open_hit_cnt, inode_revive_cnt,
+			total > 0 ? (inode_open_hit_cnt + inode_revive_cnt) * 100 / total : 0,
+			unused_cnt);
+#ifdef EFILESYS
+	printf ("Delayed allocation: %"PRIu64" sectors in %"PRIu64" writebacks, "
+			"%"PRIu64" dropped unwritten\n", da_sector_cnt, da_writeback_cnt,
+			da_drop_cnt);
+#endif
+}
+
+/* Writes back the cached pages and growth of every inode in memory,
+ * before the file system is shut down.  Each is opened while the
+ * table is locked, and closed after, which writes it back as the last
+ * close. */
+void
+inode_done (void) {
+	struct inode **all;
+	struct hash_iterator i;
+	size_t cnt = 0, j;
+
+	lock_acquire (&inodes_lock);
+	all = malloc ((hash_size (&inodes) + 1) * sizeof *all);
+	if (all == NULL)
+		PANIC ("inode_done: out of memory");
+	hash_first (&i, &inodes);
+	while (hash_next (&i)) {
+		struct inode *inode = hash_entry (hash_cur (&i), struct inode, elem);
+
+		if (inode->open_cnt++ == 0) {
+			list_remove (&inode->lru_elem);
+			unused_cnt--;
+		}
+		all[cnt++] = inode;
+	}
+	lock_release (&inodes_lock);
+
+	for (j = 0; j < cnt; j++)
+		inode_close (all[j]);
+	free (all);
+}
+
+#ifdef VM
+/* Returns the list of INODE's pages in the page cache. */
+struct list *
+inode_cached_pages (struct inode *inode) {
+	return &inode->cached_pages;
+}
+#endif
+
 /* Returns the length, in bytes, of INODE's data. */
 off_t
 inode_length (const struct inode *inode) {
@@ -0,0 +1,340 @@
+/* journal.c: Write-ahead journal for file system metadata.
+ *
+ * Inode sectors, directory contents and the free map are metadata.
+ * Their writes land in the buffer cache as usual, but the cache
+ * keeps them pinned and also hands a copy of each to journal_log(),
+ * which collects them in the running transaction.  Nothing pinned
+ * goes to its home sector until the transaction holding it has been
+ * committed to the journal.
+ *
+ * A file system operation brackets its writes with journal_start()
+ * and journal_stop(), so that it lands in a single transaction.  The
+ * "jcommit" thread commits the running transaction every
+ * JOURNAL_INTERVAL ticks, so many operations share one commit: it
+ * writes a descriptor block listing the sectors, their contents and
+ * a commit block, then writes the contents home and advances the
+ * superblock.  An operation that would overflow the transaction
+ * commits it first.
+ *
+ * Since every transaction is written home before the next one is
+ * logged, the journal holds at most one transaction, always right
+ * after the superblock.  On mount, a transaction there whose
+ * sequence number the superblock expects and whose commit block made
+ * it to disk is written home again; a torn one is ignored.
+ *
+ * The FAT of EFILESYS is kept in memory and written only at
+ * shutdown, so it is not journaled. */
+
+#include "filesys/journal.h"
+#include <debug.h>
+#include <inttypes.h>
+#include <round.h>
+#include <stdio.h>
+#include <string.h>
+#include "devices/timer.h"
+#include "filesys/buffer_cache.h"
+#include "filesys/filesys.h"
+#include "threads/palloc.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
+
+/* Magic numbers of the journal's blocks. */
+#define JOURNAL_SUPER_MAGIC 0x4a53555052     /* "JSUPR" */
+#define JOURNAL_DESC_MAGIC 0x4a44455343      /* "JDESC" */
+#define JOURNAL_COMMIT_MAGIC 0x4a434d4954    /* "JCMIT" */
+
+/* Sectors an operation may log without overflowing its transaction,
+ * and how often the running transaction is committed. */
+#define JOURNAL_CREDITS 8
+#define JOURNAL_INTERVAL (TIMER_FREQ / 5)
+
+/* First block of the journal. */
+struct journal_super {
+	uint64_t magic;
+	uint64_t seq;                  /* Transaction expected next. */
+};
+
+/* Starts a logged transaction; followed by CNT data blocks and a
+ * struct journal_commit_block. */
+struct journal_desc {
+	uint64_t magic;
+	uint64_t seq;
+	uint32_t cnt;
+	disk_sector_t sectors[JOURNAL_TXN_MAX];
+};
+
+struct journal_commit_block {
+	uint64_t magic;
+	uint64_t seq;
+	uint32_t cnt;
+};
+
+/* Metadata sectors collected for one commit. */
+struct txn {
+	uint64_t seq;
+	size_t cnt;
+	disk_sector_t sectors[JOURNAL_TXN_MAX];
+	uint8_t *data;                 /* CNT sectors' contents. */
+};
+
+bool journal_enabled = true;
+
+static struct txn txns[2];
+static struct txn *running;            /* Collecting writes. */
+static size_t handle_cnt;              /* Operations in RUNNING. */
+static bool locked;                    /* RUNNING is being sealed. */
+static struct lock journal_lock;
+static struct condition journal_cond;  /* Broadcast on every change. */
+static struct lock commit_lock;        /* Serializes commits. */
+static uint8_t *block;                 /* Bounce buffer for commits. */
+
+/* Statistics. */
+static uint64_t op_cnt;                /* Operations started. */
+static uint64_t commit_cnt;            /* Transactions committed. */
+static uint64_t logged_cnt;            /* Sectors written to the log. */
+static uint64_t replay_cnt;            /* Sectors replayed on mount. */
+
+static void jcommit (void *aux UNUSED);
+
+/* Returns the sector of journal block N. */
+static disk_sector_t
+journal_block (size_t n) {
+	return JOURNAL_SECTOR + n;
+}
+
+/* Writes a superblock expecting transaction SEQ next. */
+static void
+journal_write_super (uint64_t seq) {
+	struct journal_super *sb = (struct journal_super *) block;
+
+	memset (block, 0, DISK_SECTOR_SIZE);
+	sb->magic = JOURNAL_SUPER_MAGIC;
+	sb->seq = seq;
+	disk_write (filesys_disk, journal_block (0), block);
+}
+
+/* Writes a committed transaction left in the journal home, and
+ * returns the sequence number to expect next, or 0 if the disk has
+ * no journal. */
+static uint64_t
+journal_replay (void) {
+	static struct journal_desc desc;
+	struct journal_super *sb = (struct journal_super *) block;
+	struct journal_commit_block *cb = (struct journal_commit_block *) block;
+	uint64_t seq;
+	size_t i;
+
+	disk_read (filesys_disk, journal_block (0), block);
+	if (sb->magic != JOURNAL_SUPER_MAGIC)
+		return 0;
+	seq = sb->seq;
+
+	disk_read (filesys_disk, journal_block (1), block);
+	memcpy (&desc, block, sizeof desc);
+	if (desc.magic != JOURNAL_DESC_MAGIC || desc.seq != seq
+			|| desc.cnt > JOURNAL_TXN_MAX)
+		return seq;
+	disk_read (filesys_disk, journal_block (2 + desc.cnt), block);
+	if (cb->magic != JOURNAL_COMMIT_MAGIC || cb->seq != seq
+			|| cb->cnt != desc.cnt)
+		return seq;
+
+	for (i = 0; i < desc.cnt; i++) {
+		disk_read (filesys_disk, journal_block (2 + i), block);
+		disk_write (filesys_disk, desc.sectors[i], block);
+	}
+	replay_cnt += desc.cnt;
+	printf ("journal: replayed transaction %"PRIu64", %"PRIu32" sectors\n",
+			seq, desc.cnt);
+	return seq + 1;
+}
+
+/* Sets up the journal, replaying what a crash left in it, or
+ * starting it afresh if FORMAT.  Must run before anything else
+ * reads the file system disk. */
+void
+journal_init (bool format) {
+	uint64_t seq;
+	size_t i;
+
+	ASSERT (sizeof (struct journal_desc) <= DISK_SECTOR_SIZE);
+
+	lock_init (&journal_lock);
+	cond_init (&journal_cond);
+	lock_init (&commit_lock);
+	block = palloc_get_page (PAL_ASSERT);
+	for (i = 0; i < 2; i++)
+		txns[i].data = palloc_get_multiple (PAL_ASSERT,
+				DIV_ROUND_UP (JOURNAL_TXN_MAX * DISK_SECTOR_SIZE, PGSIZE));
+
+	seq = format ? 1 : journal_replay ();
+	running = &txns[0];
+	running->seq = seq;
+	running->cnt = 0;
+	if (seq == 0) {
+		/* Formatted without a journal: its sectors may hold data. */
+		printf ("journal: none on disk, metadata is not journaled\n");
+		journal_enabled = false;
+		return;
+	}
+	journal_write_super (seq);
+
+	thread_create ("jcommit", PRI_DEFAULT, jcommit, NULL);
+}
+
+/* Returns whether one more operation fits in the running
+ * transaction. */
+static bool
+journal_has_room (void) {
+	return running->cnt + (handle_cnt + 1) * JOURNAL_CREDITS
+		<= JOURNAL_TXN_MAX;
+}
+
+/* Begins a file system operation.  Its metadata writes, up to
+ * journal_stop(), commit together.  Operations nest. */
+void
+journal_start (void) {
+	struct thread *t = thread_current ();
+
+	if (!journal_enabled || t->journal_depth++ > 0)
+		return;
+
+	lock_acquire (&journal_lock);
+	while (locked || !journal_has_room ()) {
+		if (!locked && handle_cnt == 0) {
+			/* Full and idle: commit it now. */
+			lock_release (&journal_lock);
+			journal_commit ();
+			lock_acquire (&journal_lock);
+			continue;
+		}
+		cond_wait (&journal_cond, &journal_lock);
+	}
+	handle_cnt++;
+	op_cnt++;
+	lock_release (&journal_lock);
+}
+
+/* Ends the operation begun by journal_start(). */
+void
+journal_stop (void) {
+	struct thread *t = thread_current ();
+
+	if (!journal_enabled)
+		return;
+	ASSERT (t->journal_depth > 0);
+	if (--t->journal_depth > 0)
+		return;
+
+	lock_acquire (&journal_lock);
+	if (--handle_cnt == 0)
+		cond_broadcast (&journal_cond, &journal_lock);
+	lock_release (&journal_lock);
+}
+
+/* Logs DATA, the new contents of metadata SECTOR, in the running
+ * transaction and returns its sequence number.  The caller must be
+ * inside journal_start(). */
+uint64_t
+journal_log (disk_sector_t sector, const void *data) {
+	uint64_t seq;
+	size_t i;
+
+	ASSERT (thread_current ()->journal_depth > 0);
+
+	lock_acquire (&journal_lock);
+	for (i = 0; i < running->cnt; i++)
+		if (running->sectors[i] == sector)
+			break;
+	if (i == running->cnt) {
+		if (running->cnt == JOURNAL_TXN_MAX)
+			PANIC ("journal: transaction overflow");
+		running->sectors[running->cnt++] = sector;
+	}
+	memcpy (running->data + i * DISK_SECTOR_SIZE, data, DISK_SECTOR_SIZE);
+	seq = running->seq;
+	lock_release (&journal_lock);
+	return seq;
+}
+
+/* Commits the running transaction, if it logged anything, and writes
+ * its sectors home. */
+void
+journal_commit (void) {
+	struct journal_desc *desc = (struct journal_desc *) block;
+	struct journal_commit_block *cb = (struct journal_commit_block *) block;
+	struct txn *t;
+	size_t i;
+
+	lock_acquire (&commit_lock);
+
+	/* Seal the running transaction once its operations are done, and
+	 * let new ones start on the other. */
+	lock_acquire (&journal_lock);
+	if (running->cnt == 0) {
+		lock_release (&journal_lock);
+		lock_release (&commit_lock);
+		return;
+	}
+	locked = true;
+	while (handle_cnt > 0)
+		cond_wait (&journal_cond, &journal_lock);
+	t = running;
+	running = t == &txns[0] ? &txns[1] : &txns[0];
+	running->seq = t->seq + 1;
+	running->cnt = 0;
+	locked = false;
+	cond_broadcast (&journal_cond, &journal_lock);
+	lock_release (&journal_lock);
+
+	/* Log it. */
+	for (i = 0; i < t->cnt; i++)
+		disk_write (filesys_disk, journal_block (2 + i),
+				t->data + i * DISK_SECTOR_SIZE);
+	memset (block, 0, DISK_SECTOR_SIZE);
+	desc->magic = JOURNAL_DESC_MAGIC;
+	desc->seq = t->seq;
+	desc->cnt = t->cnt;
+	memcpy (desc->sectors, t->sectors, t->cnt * sizeof *t->sectors);
+	disk_write (filesys_disk, journal_block (1), block);
+	memset (block, 0, DISK_SECTOR_SIZE);
+	cb->magic = JOURNAL_COMMIT_MAGIC;
+	cb->seq = t->seq;
+	cb->cnt = t->cnt;
+	disk_write (filesys_disk, journal_block (2 + t->cnt), block);
+
+	/* Write it home, then retire it. */
+	for (i = 0; i < t->cnt; i++) {
+		disk_write (filesys_disk, t->sectors[i], t->data + i * DISK_SECTOR_SIZE);
+		buffer_cache_unpin (t->sectors[i], t->seq);
+	}
+	journal_write_super (t->seq + 1);
+
+	commit_cnt++;
+	logged_cnt += t->cnt;
+	t->cnt = 0;
+	lock_release (&commit_lock);
+}
+
+/* Commits whatever is left before shutdown. */
+void
+journal_done (void) {
+	journal_commit ();
+}
+
+/* Commits the running transaction every JOURNAL_INTERVAL ticks. */
+static void
+jcommit (void *aux UNUSED) {
+	for (;;) {
+		timer_sleep (JOURNAL_INTERVAL);
+		journal_commit ();
+	}
+}
+
+void
+journal_print_stats (void) {
+	printf ("Journal: %"PRIu64" operations in %"PRIu64" commits, "
+			"%"PRIu64" sectors logged, %"PRIu64" replayed\n", op_cnt, commit_cnt,
+			logged_cnt, replay_cnt);
+}
@@ -1,6 +1,44 @@
-/* page_cache.c: Implementation of Page Cache (Buffer Cache). */
+/* page_cache.c: Per-inode page cache, shared by file I/O and mmap.
+ *
+ * Each cached page of a file is a `struct page' of type VM_PAGE_CACHE
+ * that owns a frame on the reclaim lists like any other page, but
+ * that no process maps.  inode_read_at() and inode_write_at() copy to
+ * and from these frames, and a shared file mapping maps the very same
+ * frame as one of its sharers.  A store through a mapping is thus seen
+ * by the next read(), and a file mapped by several processes is in
+ * memory once.
+ *
+ * Pages are found by inode and offset in one hash, and are also listed
+ * per inode, so that an inode's last close can write its own pages
+ * back and freeing the inode can throw them away.  A page written by
+ * write() or through a mapping is dirty until it is written back: by
+ * the worker daemon once it has been dirty for PC_DIRTY_EXPIRE, by
+ * reclaim, by msync(), or at the inode's last close.  All but reclaim,
+ * which needs the frame right away, queue the pages to the batching
+ * writeback thread of vm/writeback.c.  The pages of a removed file are
+ * dropped unwritten.
+ *
+ * Everything here is protected by frame_lock, like the frames.  Data
+ * is copied, and pages are written back, without the lock, from and
+ * to user memory that may fault and through the journal, while the
+ * frame is pinned: taken off the reclaim lists. */
 
+#include "filesys/page_cache.h"
+#include <debug.h>
+#include <hash.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+#include "devices/timer.h"
+#include "filesys/inode.h"
+#include "threads/malloc.h"
+#include "threads/mmu.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
 #include "vm/vm.h"
+#include "vm/writeback.h"
+
+#ifdef VM
 static bool page_cache_readahead (struct page *page, void *kva);
 static bool page_cache_writeback (struct page *page);
 static void page_cache_destroy (struct page *page);
@@ -13,38 +51,528 @@ static const struct page_operations page_cache_op = {
 	.type = VM_PAGE_CACHE,
 };
 
+/* How often the worker daemon runs, and how long a page may stay
+ * dirty before it writes the page back, in timer ticks. */
+#define PC_FLUSH_INTERVAL (TIMER_FREQ)
+#define PC_DIRTY_EXPIRE (5 * TIMER_FREQ)
+
+/* Pages after a loaded one whose sectors are read ahead. */
+#define PC_READAHEAD_PAGES 2
+
+/* Set once the VM can hand out frames; until then inodes bypass the
+ * page cache. */
+bool page_cache_enabled;
+
+static struct hash pages;
+static struct condition page_ready;   /* A page was loaded, unpinned or
+                                         written back. */
+
 tid_t page_cache_workerd;
 
-/* The initializer of file vm */
+/* Statistics. */
+static uint64_t pc_hit_cnt;             /* Lookups of a cached page. */
+static uint64_t pc_load_cnt;            /* Pages loaded from the file. */
+static uint64_t pc_writeback_cnt;       /* Dirty pages written back. */
+
+static void page_cache_kworkerd (void *aux);
+
+static uint64_t
+pc_hash (const struct hash_elem *e, void *aux UNUSED) {
+	const struct page *page = hash_entry (e, struct page, hash_elem);
+	return hash_int (inode_get_inumber (page->page_cache.inode))
+		^ hash_int (page->page_cache.ofs / PGSIZE);
+}
+
+static bool
+pc_less (const struct hash_elem *a_, const struct hash_elem *b_,
+		void *aux UNUSED) {
+	const struct page_cache *a = &hash_entry (a_, struct page, hash_elem)
+		->page_cache;
+	const struct page_cache *b = &hash_entry (b_, struct page, hash_elem)
+		->page_cache;
+
+	if (a->inode != b->inode)
+		return inode_get_inumber (a->inode) < inode_get_inumber (b->inode);
+	return a->ofs < b->ofs;
+}
+
+/* Initializes the page cache and starts its worker daemon. */
 void
 pagecache_init (void) {
-	/* TODO: Create a worker daemon for page cache with page_cache_kworkerd */
+	if (!hash_init (&pages, pc_hash, pc_less, NULL))
+		PANIC ("page cache: out of memory");
+	cond_init (&page_ready);
+	page_cache_workerd = thread_create ("pcflushd", PRI_DEFAULT,
+			page_cache_kworkerd, NULL);
+	page_cache_enabled = true;
 }
 
-/* Initialize the page cache */
+/* Sets up PAGE as a page cache page. */
 bool
-page_cache_initializer (struct page *page, enum vm_type type, void *kva) {
-	/* Set up the handler */
+page_cache_initializer (struct page *page, enum vm_type type UNUSED,
+		void *kva UNUSED) {
 	page->operations = &page_cache_op;
+	page->writable = true;
+	return true;
+}
+
+/* Returns the cached page of INODE at OFS, or a null pointer. */
+static struct page *
+pc_find (struct inode *inode, off_t ofs) {
+	struct page key;
+	struct hash_elem *e;
+
+	key.page_cache.inode = inode;
+	key.page_cache.ofs = ofs;
+	e = hash_find (&pages, &key.hash_elem);
+	return e != NULL ? hash_entry (e, struct page, hash_elem) : NULL;
+}
+
+/* Takes PAGE out of the cache. */
+static void
+pc_unlink (struct page *page) {
+	hash_delete (&pages, &page->hash_elem);
+	list_remove (&page->page_cache.inode_elem);
+}
+
+/* Marks PC dirty, keeping the time it first became so. */
+static void
+pc_mark_dirty (struct page_cache *pc) {
+	if (!pc->dirty) {
+		pc->dirty = true;
+		pc->dirtied = timer_ticks ();
+	}
+}
+
+/* Moves the dirty bits of the mappings that share PAGE's frame over
+ * to PAGE. */
+static void
+pc_collect_dirty (struct page *page) {
+	struct list_elem *e;
+
+	for (e = list_begin (&page->frame->sharers);
+			e != list_end (&page->frame->sharers); e = list_next (e)) {
+		struct page *p = list_entry (e, struct page, share_elem);
+
+		if (pml4_is_dirty (p->pml4, p->va)) {
+			pml4_set_dirty (p->pml4, p->va, false);
+			pc_mark_dirty (&page->page_cache);
+		}
+	}
+}
+
+/* Pins PAGE, which has a frame, so that reclaim leaves it alone. */
+static void
+pc_pin (struct page *page) {
+	struct page_cache *pc = &page->page_cache;
+
+	if (pc->pin_cnt++ == 0) {
+		pc->active = page->frame->lru == LRU_ACTIVE;
+		vm_frame_set_lru (page->frame, LRU_NONE);
+	}
+}
+
+/* Unpins PAGE, putting its frame back where it was on the reclaim
+ * lists once nobody has it pinned. */
+static void
+pc_unpin (struct page *page) {
+	struct page_cache *pc = &page->page_cache;
+
+	if (--pc->pin_cnt == 0) {
+		vm_frame_set_lru (page->frame, pc->active ? LRU_ACTIVE : LRU_INACTIVE);
+		cond_broadcast (&page_ready, &frame_lock);
+	}
+}
+
+/* Starts writing back PAGE, which has a frame, if it is dirty:
+ * pins it and marks it clean, so that stores made during the write
+ * dirty it again.  Returns false if PAGE is clean. */
+static bool
+pc_write_start (struct page *page) {
+	struct page_cache *pc = &page->page_cache;
+
+	ASSERT (lock_held_by_current_thread (&frame_lock));
+
+	/* Two writes of one page must not finish out of order. */
+	while (pc->writeback)
+		cond_wait (&page_ready, &frame_lock);
+	pc_collect_dirty (page);
+	if (!pc->dirty)
+		return false;
+	pc_pin (page);
+	pc->writeback = true;
+	pc->dirty = false;
+	return true;
+}
+
+/* Writes PAGE, which pc_write_start() returned true for, to its file,
+ * without frame_lock: the write may reach the journal.  Only the part
+ * before the end of file is written. */
+static void
+pc_write_page (struct page *page) {
+	struct page_cache *pc = &page->page_cache;
+	off_t left = inode_length (pc->inode) - pc->ofs;
+
+	if (left > 0)
+		inode_write_direct (pc->inode, page->frame->kva,
+				left < PGSIZE ? left : PGSIZE, pc->ofs);
+}
+
+/* Finishes the write of PAGE and unpins it. */
+static void
+pc_write_end (struct page *page) {
+	ASSERT (lock_held_by_current_thread (&frame_lock));
+
+	page->page_cache.writeback = false;
+	pc_writeback_cnt++;
+	pc_unpin (page);
+	cond_broadcast (&page_ready, &frame_lock);
+}
+
+/* Hands the pages on LIST, which pc_write_start() returned true for,
+ * to the writeback thread.  frame_lock must not be held. */
+static void
+pc_queue (struct list *list) {
+	while (!list_empty (list))
+		writeback_page (list_entry (list_pop_front (list), struct page,
+					page_cache.wb_elem));
+}
+
+/* Writes PAGE, which has a frame, to its file if it is dirty,
+ * releasing frame_lock meanwhile.  Returns whether PAGE was
+ * written. */
+static bool
+pc_write (struct page *page) {
+	if (!pc_write_start (page))
+		return false;
+	lock_release (&frame_lock);
+	pc_write_page (page);
+	lock_acquire (&frame_lock);
+	pc_write_end (page);
+	return true;
+}
 
+/* Returns the frame holding the page of INODE at OFS, a multiple of
+ * PGSIZE, loading the page first if it is not cached.  If LOAD is
+ * false the caller overwrites the whole page, so a page that is not
+ * cached starts out as zeros instead.  The frame is pinned until
+ * page_cache_put().  Returns a null pointer if the page cannot be
+ * loaded. */
+struct frame *
+page_cache_get (struct inode *inode, off_t ofs, bool load) {
+	struct page *page;
+	struct frame *frame;
+
+	ASSERT (ofs % PGSIZE == 0);
+
+	lock_acquire (&frame_lock);
+	while ((page = pc_find (inode, ofs)) != NULL && page->frame == NULL)
+		cond_wait (&page_ready, &frame_lock);
+	if (page != NULL) {
+		pc_pin (page);
+		page->page_cache.referenced = true;
+		pc_hit_cnt++;
+		lock_release (&frame_lock);
+		return page->frame;
+	}
+
+	/* Enter the page without a frame, so that others wait for this
+	 * load instead of starting their own. */
+	page = calloc (1, sizeof *page);
+	if (page == NULL) {
+		lock_release (&frame_lock);
+		return NULL;
+	}
+	page_cache_initializer (page, VM_PAGE_CACHE, NULL);
+	page->page_cache.inode = inode;
+	page->page_cache.ofs = ofs;
+	page->page_cache.pin_cnt = 1;
+	hash_insert (&pages, &page->hash_elem);
+	list_push_back (inode_cached_pages (inode), &page->page_cache.inode_elem);
+	lock_release (&frame_lock);
+
+	/* A new frame is on no reclaim list, so it is pinned already. */
+	frame = vm_frame_alloc ();
+	if (load && !swap_in (page, frame->kva)) {
+		lock_acquire (&frame_lock);
+		pc_unlink (page);
+		free (page);
+		vm_frame_free (frame);
+		cond_broadcast (&page_ready, &frame_lock);
+		lock_release (&frame_lock);
+		return NULL;
+	}
+
+	lock_acquire (&frame_lock);
+	frame->page = page;
+	page->frame = frame;
+	page->page_cache.referenced = true;
+	if (load)
+		pc_load_cnt++;
+	cond_broadcast (&page_ready, &frame_lock);
+	lock_release (&frame_lock);
+	return frame;
+}
+
+/* Unpins FRAME, which page_cache_get() returned, marking its page
+ * dirty if DIRTY. */
+void
+page_cache_put (struct frame *frame, bool dirty) {
+	lock_acquire (&frame_lock);
+	if (dirty)
+		pc_mark_dirty (&frame->page->page_cache);
+	pc_unpin (frame->page);
+	lock_release (&frame_lock);
+}
+
+/* Reads SIZE bytes from INODE into BUFFER, starting at position
+ * OFFSET, through the page cache.  Returns the number of bytes
+ * actually read, which is less than SIZE at end of file or if a page
+ * cannot be loaded. */
+off_t
+page_cache_read (struct inode *inode, void *buffer_, off_t size,
+		off_t offset) {
+	uint8_t *buffer = buffer_;
+	off_t bytes_read = 0;
+	off_t left = inode_length (inode) - offset;
+
+	if (size > left)
+		size = left;
+	while (size > 0) {
+		int page_ofs = offset % PGSIZE;
+		int chunk_size = size < PGSIZE - page_ofs ? size : PGSIZE - page_ofs;
+		struct frame *frame = page_cache_get (inode, offset - page_ofs, true);
+
+		if (frame == NULL)
+			break;
+		memcpy (buffer + bytes_read, frame->kva + page_ofs, chunk_size);
+		page_cache_put (frame, false);
+
+		size -= chunk_size;
+		offset += chunk_size;
+		bytes_read += chunk_size;
+	}
+	return bytes_read;
+}
+
+/* Writes SIZE bytes from BUFFER into INODE, starting at OFFSET,
+ * through the page cache.  The file is not extended: the caller
+ * grows it first.  Returns the number of bytes actually written. */
+off_t
+page_cache_write (struct inode *inode, const void *buffer_, off_t size,
+		off_t offset) {
+	const uint8_t *buffer = buffer_;
+	off_t bytes_written = 0;
+	off_t left = inode_length (inode) - offset;
+
+	if (size > left)
+		size = left;
+	while (size > 0) {
+		int page_ofs = offset % PGSIZE;
+		int chunk_size = size < PGSIZE - page_ofs ? size : PGSIZE - page_ofs;
+		struct frame *frame = page_cache_get (inode, offset - page_ofs,
+				chunk_size < PGSIZE);
+
+		if (frame == NULL)
+			break;
+		memcpy (frame->kva + page_ofs, buffer + bytes_written, chunk_size);
+		page_cache_put (frame, true);
+
+		size -= chunk_size;
+		offset += chunk_size;
+		bytes_written += chunk_size;
+	}
+	return bytes_written;
+}
+
+/* Marks PAGE, a page cache page, dirty on behalf of a mapping that
+ * wrote its frame and is going away. */
+void
+page_cache_set_dirty (struct page *page) {
+	ASSERT (lock_held_by_current_thread (&frame_lock));
+	ASSERT (page_get_type (page) == VM_PAGE_CACHE);
+
+	pc_mark_dirty (&page->page_cache);
 }
 
-/* Utilze the Swap in mechanism to implement readhead */
+/* Returns whether PAGE, a page cache page, was used since the last
+ * call, and forgets that it was. */
+bool
+page_cache_accessed (struct page *page) {
+	bool referenced = page->page_cache.referenced;
+
+	page->page_cache.referenced = false;
+	return referenced;
+}
+
+/* Writes PAGE, a page cache page, back right away if it or a mapping
+ * of it is dirty, for msync() and for reclaim.  Returns whether it
+ * wrote, in which case frame_lock was released meanwhile and PAGE's
+ * frame went back on the reclaim lists, unless someone else still has
+ * it pinned. */
+bool
+page_cache_sync (struct page *page) {
+	return pc_write (page);
+}
+
+/* Queues PAGE, a page cache page, for writeback if it or a mapping of
+ * it is dirty, for msync().  Returns whether it did, in which case
+ * frame_lock was released meanwhile. */
+bool
+page_cache_queue (struct page *page) {
+	if (!pc_write_start (page))
+		return false;
+	lock_release (&frame_lock);
+	writeback_page (page);
+	lock_acquire (&frame_lock);
+	return true;
+}
+
+/* Called by the writeback thread once PAGE, queued by the page cache,
+ * is in its file. */
+void
+page_cache_written (struct page *page) {
+	lock_acquire (&frame_lock);
+	pc_write_end (page);
+	lock_release (&frame_lock);
+}
+
+/* Writes back the dirty pages of INODE in batches and waits for them.
+ * A pinned page stays in the list while pc_write_start() waits for an
+ * earlier write of it, so the walk can go on from it. */
+void
+page_cache_flush (struct inode *inode) {
+	struct list *list = inode_cached_pages (inode);
+	struct list dirty;
+	struct list_elem *e;
+
+	list_init (&dirty);
+	lock_acquire (&frame_lock);
+	for (e = list_begin (list); e != list_end (list); e = list_next (e)) {
+		struct page *page = list_entry (e, struct page, page_cache.inode_elem);
+
+		if (page->frame != NULL) {
+			pc_pin (page);
+			if (pc_write_start (page))
+				list_push_back (&dirty, &page->page_cache.wb_elem);
+			pc_unpin (page);
+		}
+	}
+	lock_release (&frame_lock);
+
+	pc_queue (&dirty);
+	writeback_wait (inode);
+}
+
+/* Throws away the pages of INODE unwritten.  Only the caller may have
+ * INODE open, so no page is added meanwhile; pages being written back
+ * are waited for. */
+void
+page_cache_drop (struct inode *inode) {
+	struct list *list = inode_cached_pages (inode);
+
+	lock_acquire (&frame_lock);
+	while (!list_empty (list)) {
+		struct page *page = list_entry (list_front (list), struct page,
+				page_cache.inode_elem);
+
+		if (page->page_cache.pin_cnt > 0)
+			cond_wait (&page_ready, &frame_lock);
+		else
+			vm_dealloc_page (page);
+	}
+	lock_release (&frame_lock);
+}
+
+/* Reads PAGE from its file into KVA, zeroing what lies past end of
+ * file, and starts reading the sectors of the next few pages into the
+ * buffer cache. */
 static bool
 page_cache_readahead (struct page *page, void *kva) {
+	struct page_cache *pc = &page->page_cache;
+	off_t left = inode_length (pc->inode) - pc->ofs;
+	off_t bytes = left < 0 ? 0 : left < PGSIZE ? left : PGSIZE;
+
+	if (bytes > 0 && inode_read_direct (pc->inode, kva, bytes, pc->ofs)
+			!= bytes)
+		return false;
+	memset (kva + bytes, 0, PGSIZE - bytes);
+	inode_readahead (pc->inode, PC_READAHEAD_PAGES * PGSIZE, pc->ofs + PGSIZE);
+	return true;
 }
 
-/* Utilze the Swap out mechanism to implement writeback */
+/* Takes PAGE out of the cache, so that reclaim can reuse its frame.
+ * The mappings of the frame were swapped out first and handed their
+ * dirty bits over.  Reclaim writes dirty pages back with
+ * page_cache_sync() beforehand, since it cannot release frame_lock
+ * here; a page dirtied again since is kept, returning false.  A
+ * cached page lives only as long as its frame. */
 static bool
 page_cache_writeback (struct page *page) {
+	if (page->page_cache.dirty)
+		return false;
+	pc_unlink (page);
+	page->frame->page = NULL;
+	free (page);
+	return true;
 }
 
-/* Destory the page_cache. */
+/* Takes PAGE out of the cache and frees its frame, without writing it
+ * back.  PAGE will be freed by the caller. */
 static void
 page_cache_destroy (struct page *page) {
+	ASSERT (page->page_cache.pin_cnt == 0);
+
+	pc_unlink (page);
+	if (page->frame != NULL) {
+		page->frame->page = NULL;
+		vm_frame_free (page->frame);
+		page->frame = NULL;
+	}
 }
 
-/* Worker thread for page cache */
+void
+page_cache_print_stats (void) {
+	uint64_t total = pc_hit_cnt + pc_load_cnt;
+
+	printf ("Page cache: %"PRIu64" hits, %"PRIu64" loads (%"PRIu64"%% hit "
+			"rate), %"PRIu64" pages written back, %zu cached\n", pc_hit_cnt,
+			pc_load_cnt, total > 0 ? pc_hit_cnt * 100 / total : 0,
+			pc_writeback_cnt, hash_size (&pages));
+}
+
+/* Every PC_FLUSH_INTERVAL, picks up the writes made through mappings
+ * and writes back the pages that have been dirty for PC_DIRTY_EXPIRE,
+ * so that little is lost in a crash.  The pages are picked and pinned
+ * in one pass over the table, then queued for writeback without
+ * frame_lock. */
 static void
-page_cache_kworkerd (void *aux) {
+page_cache_kworkerd (void *aux UNUSED) {
+	for (;;) {
+		struct hash_iterator i;
+		struct list expired;
+
+		timer_sleep (PC_FLUSH_INTERVAL);
+		list_init (&expired);
+		lock_acquire (&frame_lock);
+		hash_first (&i, &pages);
+		while (hash_next (&i)) {
+			struct page *page = hash_entry (hash_cur (&i), struct page,
+					hash_elem);
+
+			/* pc_write_start() must not wait, which would let the
+			 * table change under the iterator. */
+			if (page->frame == NULL || page->page_cache.writeback)
+				continue;
+			pc_collect_dirty (page);
+			if (page->page_cache.dirty
+					&& timer_elapsed (page->page_cache.dirtied) >= PC_DIRTY_EXPIRE
+					&& pc_write_start (page))
+				list_push_back (&expired, &page->page_cache.wb_elem);
+		}
+		lock_release (&frame_lock);
+
+		pc_queue (&expired);
+	}
 }
+#endif /* VM */
@@ -0,0 +1,20 @@
+#ifndef FILESYS_BUFFER_CACHE_H
+#define FILESYS_BUFFER_CACHE_H
+#include <stddef.h>
+#include <stdint.h>
+#include "devices/disk.h"
+
+void buffer_cache_init (void);
+void buffer_cache_read (disk_sector_t sector, void *buffer, size_t ofs,
+		size_t size);
+void buffer_cache_write (disk_sector_t sector, const void *buffer, size_t ofs,
+		size_t size);
+void buffer_cache_write_meta (disk_sector_t sector, const void *buffer,
+		size_t ofs, size_t size);
+void buffer_cache_unpin (disk_sector_t sector, uint64_t seq);
+void buffer_cache_readahead (disk_sector_t sector);
+void buffer_cache_flush (void);
+void buffer_cache_done (void);
+void buffer_cache_print_stats (void);
+
+#endif /* filesys/buffer_cache.h */
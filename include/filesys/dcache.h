@@ -0,0 +1,22 @@
+#ifndef FILESYS_DCACHE_H
+#define FILESYS_DCACHE_H
+#include "devices/disk.h"
+#include "filesys/off_t.h"
+
+/* What the name cache knows about a name. */
+enum dcache_result {
+	DCACHE_MISS,            /* Nothing cached. */
+	DCACHE_NEGATIVE,        /* Known not to exist. */
+	DCACHE_HIT              /* Exists; sector and slot returned. */
+};
+
+void dcache_init (void);
+enum dcache_result dcache_lookup (disk_sector_t dir, const char *name,
+		disk_sector_t *sector, off_t *ofs);
+void dcache_insert (disk_sector_t dir, const char *name,
+		disk_sector_t sector, off_t ofs);
+void dcache_insert_negative (disk_sector_t dir, const char *name);
+void dcache_forget_dir (disk_sector_t dir);
+void dcache_print_stats (void);
+
+#endif /* filesys/dcache.h */
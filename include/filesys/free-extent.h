@@ -0,0 +1,24 @@
+#ifndef FILESYS_FREE_EXTENT_H
+#define FILESYS_FREE_EXTENT_H
+
+#include <list.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* Free space as a sorted set of disjoint runs of free blocks. */
+struct free_extents {
+	struct list runs;           /* struct free_run, by start. */
+	size_t run_cnt;             /* Runs on the list. */
+	size_t free_cnt;            /* Blocks in all runs. */
+};
+
+void free_extents_init (struct free_extents *);
+void free_extents_clear (struct free_extents *);
+void free_extents_add (struct free_extents *, uint32_t start, size_t cnt);
+bool free_extents_alloc (struct free_extents *, size_t cnt, uint32_t hint,
+		uint32_t *startp);
+size_t free_extents_alloc_some (struct free_extents *, size_t cnt,
+		uint32_t hint, uint32_t *startp);
+
+#endif /* filesys/free-extent.h */
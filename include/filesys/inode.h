@@ -6,6 +6,7 @@
 #include "devices/disk.h"
 
 struct bitmap;
+struct list;
 
 void inode_init (void);
 bool inode_create (disk_sector_t, off_t);
@@ -16,8 +17,17 @@ void inode_close (struct inode *);
 void inode_remove (struct inode *);
 off_t inode_read_at (struct inode *, void *, off_t size, off_t offset);
 off_t inode_write_at (struct inode *, const void *, off_t size, off_t offset);
+off_t inode_read_direct (struct inode *, void *, off_t size, off_t offset);
+off_t inode_write_direct (struct inode *, const void *, off_t size,
+		off_t offset);
 void inode_deny_write (struct inode *);
 void inode_allow_write (struct inode *);
 off_t inode_length (const struct inode *);
+void inode_set_meta (struct inode *);
+void inode_print_stats (void);
+disk_sector_t inode_get_sector (struct inode *, off_t pos);
+void inode_readahead (struct inode *, off_t size, off_t offset);
+void inode_done (void);
+struct list *inode_cached_pages (struct inode *);
 
 #endif /* filesys/inode.h */
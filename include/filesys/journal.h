@@ -0,0 +1,24 @@
+#ifndef FILESYS_JOURNAL_H
+#define FILESYS_JOURNAL_H
+#include <stdbool.h>
+#include <stdint.h>
+#include "devices/disk.h"
+
+/* Most metadata sectors one transaction logs. */
+#define JOURNAL_TXN_MAX 48
+
+/* Sectors of the journal: a superblock, then room for the
+ * descriptor, data and commit blocks of one transaction. */
+#define JOURNAL_SECTORS (JOURNAL_TXN_MAX + 3)
+
+extern bool journal_enabled;
+
+void journal_init (bool format);
+void journal_start (void);
+void journal_stop (void);
+uint64_t journal_log (disk_sector_t sector, const void *data);
+void journal_commit (void);
+void journal_done (void);
+void journal_print_stats (void);
+
+#endif /* filesys/journal.h */
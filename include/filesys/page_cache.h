@@ -1,12 +1,46 @@
 #ifndef FILESYS_PAGE_CACHE_H
 #define FILESYS_PAGE_CACHE_H
-#include "vm/vm.h"
+#include <list.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include "filesys/off_t.h"
 
 struct page;
+struct frame;
+struct inode;
 enum vm_type;
 
-struct page_cache {};
+/* Page of a file in the page cache.  No process maps the page itself;
+ * file mappings map its frame as sharers. */
+struct page_cache {
+	struct inode *inode;           /* File the page belongs to. */
+	off_t ofs;                     /* Offset in the file, page-aligned. */
+	struct list_elem inode_elem;   /* Element in the inode's cached pages. */
+	unsigned pin_cnt;              /* Users copying to or from the frame. */
+	bool active;                   /* On the active list before pinning. */
+	bool referenced;               /* Used since reclaim last looked. */
+	bool dirty;                    /* Newer than the file. */
+	bool writeback;                /* Being written to the file. */
+	struct list_elem wb_elem;      /* In a list of pages to write. */
+	int64_t dirtied;               /* Timer tick at which it became dirty. */
+};
 
-void page_cache_init (void);
+extern bool page_cache_enabled;
+
+void pagecache_init (void);
 bool page_cache_initializer (struct page *page, enum vm_type type, void *kva);
+struct frame *page_cache_get (struct inode *inode, off_t ofs, bool load);
+void page_cache_put (struct frame *frame, bool dirty);
+off_t page_cache_read (struct inode *inode, void *buffer, off_t size,
+		off_t offset);
+off_t page_cache_write (struct inode *inode, const void *buffer, off_t size,
+		off_t offset);
+void page_cache_set_dirty (struct page *page);
+bool page_cache_accessed (struct page *page);
+bool page_cache_sync (struct page *page);
+bool page_cache_queue (struct page *page);
+void page_cache_written (struct page *page);
+void page_cache_flush (struct inode *inode);
+void page_cache_drop (struct inode *inode);
+void page_cache_print_stats (void);
 #endif
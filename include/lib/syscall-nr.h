@@ -36,6 +36,12 @@ enum {
 
 	SYS_MOUNT,
 	SYS_UMOUNT,
+
+	/* Virtual memory extras. */
+	SYS_GETRUSAGE,              /* Obtain virtual memory statistics. */
+	SYS_MSYNC,                  /* Write back a file mapping. */
+	SYS_MADVISE,                /* Give advice about memory use. */
+	SYS_SBRK,                   /* Move the program break. */
 };
 
 #endif /* lib/syscall-nr.h */
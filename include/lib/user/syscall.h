@@ -4,6 +4,7 @@
 #include <stdbool.h>
 #include <debug.h>
 #include <stddef.h>
+#include <stdint.h>
 
 /* Process identifier. */
 typedef int pid_t;
@@ -12,10 +13,35 @@ typedef int pid_t;
 /* Map region identifier. */
 typedef int off_t;
 #define MAP_FAILED ((void *) NULL)
+#define MAP_ANON (-1)           /* FD for zero-filled memory, no file. */
+
+/* Flags for msync(). */
+#define MS_ASYNC 1              /* Start writing, do not wait. */
+#define MS_SYNC 4               /* Wait until written. */
+
+/* Advice for madvise(). */
+#define MADV_NORMAL 0           /* No special treatment. */
+#define MADV_SEQUENTIAL 2       /* Will be accessed in order. */
+#define MADV_WILLNEED 3         /* Will be accessed soon. */
+#define MADV_DONTNEED 4         /* Contents are no longer needed. */
+#define MADV_FREE 8             /* Contents may go unless written again. */
 
 /* Maximum characters in a filename written by readdir(). */
 #define READDIR_MAX_LEN 14
 
+/* Virtual memory statistics of a process, filled in by getrusage(). */
+struct rusage {
+	long long minor_faults;     /* Page faults served without I/O. */
+	long long major_faults;     /* Page faults that waited for I/O. */
+	long long stack_faults;     /* Page faults that grew the stack. */
+	long long swap_ins;         /* Pages read back from swap. */
+	long long swap_outs;        /* Pages written out to swap. */
+	long long cow_breaks;       /* Shared pages copied on write. */
+	long long resident_anon;    /* Anonymous pages in memory now. */
+	long long resident_file;    /* File-backed pages in memory now. */
+	long long fault_cycles;     /* TSC cycles spent handling faults. */
+};
+
 /* Typical return values from main() and arguments to exit(). */
 #define EXIT_SUCCESS 0          /* Successful execution. */
 #define EXIT_FAILURE 1          /* Unsuccessful execution. */
@@ -41,6 +67,10 @@ int dup2(int oldfd, int newfd);
 /* Project 3 and optionally project 4. */
 void *mmap (void *addr, size_t length, int writable, int fd, off_t offset);
 void munmap (void *addr);
+int getrusage (struct rusage *usage);
+int msync (void *addr, size_t length, int flags);
+int madvise (void *addr, size_t length, int advice);
+void *sbrk (intptr_t increment);
 
 /* Project 4 only. */
 bool chdir (const char *dir);
@@ -125,6 +125,9 @@ struct thread {
 	int exit_status;
 	int is_exit;
 #endif
+#ifdef FILESYS
+	int journal_depth;                  /* Nested journal_start() calls. */
+#endif
 #ifdef VM
 	/* Table for whole virtual memory owned by thread. */
 	struct supplemental_page_table spt;
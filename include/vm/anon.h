@@ -4,6 +4,7 @@
 #include "threads/vaddr.h"
 
 struct page;
+struct frame;
 enum vm_type;
 
 /** Project 3: Swap In/Out */
@@ -11,11 +12,22 @@ enum vm_type;
 /** Project 3: Swap In/Out - 한 페이지를 섹터 단위로 관리 */
 #define SLOT_SIZE (PGSIZE / DISK_SECTOR_SIZE)
 
+/** Most pages written to swap, or read ahead from it, in one go. */
+#define SWAP_CLUSTER 8
+
 struct anon_page {
     size_t slot;
+    bool lazy_free;         /* MADV_FREE: may be dropped while clean. */
 };
 
 void vm_anon_init (void);
 bool anon_initializer (struct page *page, enum vm_type type, void *kva);
+size_t anon_swap_out_cluster (struct frame **frames, size_t cnt);
+struct frame *anon_drop (struct page *page);
+void anon_swap_publish (struct page *page);
+bool anon_swap_map (struct page *page);
+void anon_swap_forget (struct frame *frame);
+void anon_fork_swapped (struct page *dst, struct page *src);
+void anon_print_stats (void);
 
 #endif
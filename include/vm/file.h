@@ -4,6 +4,7 @@
 #include "vm/vm.h"
 
 struct page;
+struct frame;
 enum vm_type;
 
 struct file_page {
@@ -11,6 +12,7 @@ struct file_page {
 	off_t ofs;
 	uint32_t read_bytes;
 	uint32_t zero_bytes;
+	bool text;              /* Shared through the text cache? */
 };
 
 struct load_segment_aux {
@@ -20,9 +22,19 @@ struct load_segment_aux {
 	uint32_t zero_bytes;
 };
 
+bool lazy_load_segment (struct page *page, void *aux);
 void vm_file_init (void);
 bool file_backed_initializer (struct page *page, enum vm_type type, void *kva);
 void *do_mmap(void *addr, size_t length, int writable,
 		struct file *file, off_t offset);
 void do_munmap (void *va);
+bool do_msync (void *addr, size_t length, bool sync);
+
+bool file_cache_mapped (struct page *page);
+bool file_cache_map (struct page *page);
+bool file_text_map (struct page *page);
+bool file_text_cached (struct file *file, off_t ofs, uint32_t read_bytes);
+void file_text_publish (struct page *page);
+void file_text_forget (struct frame *frame);
+void file_print_stats (void);
 #endif
@@ -0,0 +1,14 @@
+#ifndef VM_KSM_H
+#define VM_KSM_H
+#include <stdbool.h>
+
+struct frame;
+
+/* -ksm: Merge identical anonymous pages in the background? */
+extern bool ksm_enabled;
+
+void ksm_init (void);
+void ksm_forget (struct frame *frame);
+void ksm_print_stats (void);
+
+#endif /* vm/ksm.h */
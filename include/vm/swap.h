@@ -0,0 +1,23 @@
+#ifndef VM_SWAP_H
+#define VM_SWAP_H
+#include <stdbool.h>
+#include <stddef.h>
+
+/* Most swap areas that can be in use at once. */
+#define SWAP_AREA_MAX 4
+
+/* Swap areas to use, from -swap=; NULL means hd1:1 alone. */
+extern char *swap_option;
+
+void swap_init (void);
+size_t swap_slot_cnt (void);
+size_t swap_slot_alloc (size_t cnt);
+void swap_slot_dup (size_t slot);
+bool swap_slot_free (size_t slot);
+size_t swap_slot_refs (size_t slot);
+size_t swap_slot_limit (size_t slot);
+void swap_read_slots (size_t slot, size_t cnt, void *buf);
+void swap_write_slots (size_t slot, size_t cnt, const void *buf);
+void swap_print_stats (void);
+
+#endif /* vm/swap.h */
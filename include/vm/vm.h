@@ -25,12 +25,15 @@ enum vm_type {
 	VM_MARKER_END = (1 << 31),
 };
 
+/* Read-only text of an executable, shared between the processes that
+ * run it. */
+#define VM_TEXT VM_MARKER_1
+
 #include "vm/uninit.h"
 #include "vm/anon.h"
 #include "vm/file.h"
-#ifdef EFILESYS
+#include "vm/vma.h"
 #include "filesys/page_cache.h"
-#endif
 
 struct page_operations;
 struct thread;
@@ -56,20 +59,44 @@ struct page {
 		struct uninit_page uninit;
 		struct anon_page anon;
 		struct file_page file;
-#ifdef EFILESYS
 		struct page_cache page_cache;
-#endif
 	};
 
-	int page_cnt;
+	struct list_elem share_elem;   /* Element in frame's sharers. */
+	struct vm_stats *stats;        /* Counters of the owning process. */
+	struct vma *vma;               /* Region holding the page. */
+	struct list_elem vma_elem;     /* Element in the region's pages. */
+};
+
+/* Which reclaim list a frame is on. */
+enum frame_lru {
+	LRU_NONE,              /* On no list: being set up or torn down. */
+	LRU_ACTIVE,            /* Recently used, not a reclaim candidate. */
+	LRU_INACTIVE,          /* Reclaim candidate. */
+};
+
+/* Which same-page merging tree a frame is in. */
+enum ksm_state {
+	KSM_NONE,              /* In no tree. */
+	KSM_UNSTABLE,          /* Merge candidate seen in this pass. */
+	KSM_STABLE,            /* Merged, mapped read-only by its pages. */
 };
 
 /* The representation of "frame" */
 struct frame {
 	void *kva;
 	struct page *page;
-	struct list_elem frame_elem;
-	uint32_t accessed;
+	struct list_elem frame_elem;   /* Element in active or inactive list. */
+	enum frame_lru lru;            /* List that holds frame_elem. */
+	bool referenced;               /* Accessed once while inactive. */
+	struct list sharers;           /* Pages other than PAGE mapping it. */
+	struct text_entry *text;       /* Text cache entry, if published. */
+	struct swap_cache_entry *swap_entry; /* Swap cache entry, if any. */
+	bool cow;                      /* Shared read-only until written. */
+	enum ksm_state ksm;            /* KSM tree holding ksm_elem. */
+	struct hash_elem ksm_elem;     /* Element in a KSM tree. */
+	uint64_t ksm_sum;              /* Contents checksum at the last scan. */
+	unsigned ksm_pass;             /* Last KSM pass that looked at it. */
 };
 
 /* The function table for page operations.
@@ -88,14 +115,62 @@ struct page_operations {
 #define destroy(page) \
 	if ((page)->operations->destroy) (page)->operations->destroy (page)
 
+/* Fault-around state of one sequential stream of faults on a file
+ * mapping.  The window grows while faults keep landing right after the
+ * previous batch, and shrinks when they jump around. */
+struct fault_around {
+	struct file *file;             /* Mapped file, NULL if unused. */
+	off_t next_ofs;                /* Offset a sequential fault would hit. */
+	size_t window;                 /* Pages to populate on the next fault. */
+};
+
+#define FAULT_AROUND_SLOTS 4       /* Streams tracked per process. */
+#define FAULT_AROUND_INIT 4        /* Window of a new stream, in pages. */
+#define FAULT_AROUND_MAX 16        /* Largest window, in pages. */
+
+/* Access pattern hints given with madvise(). */
+enum vm_advice {
+	VM_ADVICE_NORMAL,              /* No special treatment. */
+	VM_ADVICE_SEQUENTIAL,          /* Read ahead hard, reclaim behind. */
+	VM_ADVICE_WILLNEED,            /* Load now. */
+	VM_ADVICE_DONTNEED,            /* Contents are no longer needed. */
+	VM_ADVICE_FREE,                /* Drop if not written again. */
+};
+
+/* Paging counters of one process, reported by getrusage(). */
+struct vm_stats {
+	uint64_t minor_faults;         /* Faults served from memory. */
+	uint64_t major_faults;         /* Faults that waited for a disk read. */
+	uint64_t stack_faults;         /* Faults that grew the stack. */
+	uint64_t swap_ins;             /* Pages brought back from swap. */
+	uint64_t swap_outs;            /* Pages sent to swap. */
+	uint64_t cow_breaks;           /* Private copies made on write. */
+	uint64_t fault_cycles;         /* TSC cycles spent in the fault handler. */
+	bool fault_io;                 /* Current fault read from disk. */
+};
+
 /* Representation of current process's memory space.
  * We don't want to force you to obey any specific design for this struct.
  * All designs up to you for this. */
 struct supplemental_page_table {
 	struct hash spt_table;
+	struct vma_tree vmas;          /* Regions, touched or not. */
+	void *heap_start;              /* First byte of the heap. */
+	void *brk;                     /* Program break: end of the heap. */
+	struct fault_around fault_around[FAULT_AROUND_SLOTS];
+	size_t fault_around_next;      /* Slot to recycle next. */
+	struct vm_stats stats;
 };
 
 #include "threads/thread.h"
+#include "threads/synch.h"
+
+/* Protects the frame lists and every page <-> frame link. */
+extern struct lock frame_lock;
+
+/* Print each process's paging counters when it exits (-vmstat). */
+extern bool vmstat_on_exit;
+
 void supplemental_page_table_init (struct supplemental_page_table *spt);
 bool supplemental_page_table_copy (struct supplemental_page_table *dst,
 		struct supplemental_page_table *src);
@@ -106,6 +181,10 @@ bool spt_insert_page (struct supplemental_page_table *spt, struct page *page);
 void spt_remove_page (struct supplemental_page_table *spt, struct page *page);
 
 void vm_init (void);
+void vm_print_stats (void);
+void spt_resident (struct supplemental_page_table *spt,
+		size_t *anon, size_t *file);
+void spt_print_stats (struct supplemental_page_table *spt, const char *name);
 bool vm_try_handle_fault (struct intr_frame *f, void *addr, bool user,
 		bool write, bool not_present);
 
@@ -115,6 +194,14 @@ bool vm_alloc_page_with_initializer (enum vm_type type, void *upage,
 		bool writable, vm_initializer *init, void *aux);
 void vm_dealloc_page (struct page *page);
 bool vm_claim_page (void *va);
+bool vm_madvise (void *addr, size_t length, enum vm_advice advice);
+void *vm_sbrk (intptr_t increment);
+struct frame *vm_frame_alloc (void);
+void vm_frame_set_lru (struct frame *frame, enum frame_lru lru);
+void vm_frame_free (struct frame *frame);
+void vm_frame_share (struct frame *frame, struct page *page);
+void vm_frame_walk (bool (*func) (struct frame *, void *), void *aux);
+bool vm_frame_unshare (struct page *page);
 enum vm_type page_get_type (struct page *page);
 
 #endif  /* VM_VM_H */
@@ -0,0 +1,49 @@
+#ifndef VM_VMA_H
+#define VM_VMA_H
+#include <list.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "filesys/off_t.h"
+#include "vm/vm.h"
+
+struct file;
+
+/* A region of a process's address space: a run of pages that share
+ * their permissions and backing.  Pages are created in the
+ * supplemental page table only when they are first touched, from the
+ * description here. */
+struct vma {
+	void *start;                   /* First page. */
+	void *end;                     /* One past the last page. */
+	enum vm_type type;             /* VM_ANON or VM_FILE, maybe VM_TEXT. */
+	bool writable;
+	bool sequential;               /* MADV_SEQUENTIAL given. */
+	bool mapped;                   /* Made by mmap(), so munmap() takes it. */
+	struct file *file;             /* Backing file, owned, or NULL. */
+	off_t ofs;                     /* Offset of START in FILE. */
+	size_t read_bytes;             /* Bytes from FILE; the rest is zeros. */
+	struct list pages;             /* Pages created so far. */
+
+	struct vma *left, *right;      /* Children in the region tree. */
+	int height;                    /* Height of the subtree. */
+};
+
+/* The regions of one process, in an AVL tree ordered by address. */
+struct vma_tree {
+	struct vma *root;
+};
+
+void vma_tree_init (struct vma_tree *tree);
+bool vma_tree_copy (struct vma_tree *dst, struct vma_tree *src);
+void vma_tree_clear (struct vma_tree *tree);
+struct vma *vma_create (struct vma_tree *tree, void *start, void *end,
+		enum vm_type type, bool writable, struct file *file, off_t ofs,
+		size_t read_bytes);
+void vma_destroy (struct vma_tree *tree, struct vma *vma);
+struct vma *vma_find (struct vma_tree *tree, const void *va);
+bool vma_overlaps (struct vma_tree *tree, const void *start, const void *end);
+bool vma_covers (struct vma_tree *tree, const void *start, const void *end);
+bool vma_extend_down (struct vma_tree *tree, struct vma *vma, void *start);
+bool vma_set_end (struct vma_tree *tree, struct vma *vma, void *end);
+
+#endif /* vm/vma.h */
@@ -0,0 +1,12 @@
+#ifndef VM_WRITEBACK_H
+#define VM_WRITEBACK_H
+
+struct inode;
+struct page;
+
+void writeback_init (void);
+void writeback_page (struct page *page);
+void writeback_wait (struct inode *inode);
+void writeback_print_stats (void);
+
+#endif /* vm/writeback.h */
@@ -0,0 +1,19 @@
+#ifndef VM_ZSWAP_H
+#define VM_ZSWAP_H
+#include <stdbool.h>
+#include <stddef.h>
+
+/* Most kernel pages the compressed pool may hold before the oldest
+ * entries are written back to the swap disk. */
+#define ZSWAP_POOL_MAX 64
+
+void zswap_init (void);
+bool zswap_store (size_t slot, const void *kva);
+bool zswap_load (size_t slot, void *kva);
+bool zswap_contains (size_t slot);
+void zswap_invalidate (size_t slot);
+bool zswap_over_budget (void);
+bool zswap_evict (size_t *slot, void *kva);
+void zswap_print_stats (void);
+
+#endif /* vm/zswap.h */
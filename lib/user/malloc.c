@@ -0,0 +1,263 @@
+#include <malloc.h>
+#include <debug.h>
+#include <round.h>
+#include <stdint.h>
+#include <string.h>
+#include <syscall.h>
+
+/* A malloc() for user programs, on top of sbrk().
+
+   Small requests are rounded up to a power of 2, from 16 bytes to
+   1 kB, and served from the free list of that size class.  An
+   empty list is refilled a whole page at a time: the page, called
+   an "arena", is divided into blocks that all go on the list at
+   once.  Pages for arenas come from a pool that grows the heap
+   POOL_BATCH pages per sbrk() call, so most calls to malloc() and
+   free() are a few pointer moves and never enter the kernel.
+   Freed blocks go back on their class's list, to be handed out
+   again; like a per-thread cache, the lists are never trimmed.
+
+   As in the kernel's malloc(), every arena starts with a header
+   that names its class, so free() finds the size of a block from
+   the page its address lies in.
+
+   Bigger requests get a run of pages of their own, whose header
+   records its length.  A freed run on top of the heap is given
+   back to the kernel; any other is kept for a later request that
+   fits in it. */
+
+#define PGSIZE 4096                 /* Bytes in a page. */
+#define ARENA_MAGIC 0x9a548eed      /* Detects arena corruption. */
+#define MIN_SIZE 16                 /* Smallest block. */
+#define CLASS_CNT 7                 /* Size classes: 16 bytes to 1 kB. */
+#define POOL_BATCH 8                /* Pages taken from sbrk() at once. */
+
+/* Arena, at the start of every page of small blocks and of every
+   run of pages for a big block. */
+struct arena {
+	unsigned magic;                 /* Always set to ARENA_MAGIC. */
+	int class;                      /* Size class, or -1 for a run. */
+	size_t page_cnt;                /* Pages in a run. */
+	struct arena *next;             /* Next free run. */
+};
+
+/* Bytes before the first block of an arena; keeps blocks aligned. */
+#define ARENA_HDR ROUND_UP (sizeof (struct arena), MIN_SIZE)
+
+/* Free block. */
+struct block {
+	struct block *next;             /* Next free block of its class. */
+};
+
+static struct block *free_lists[CLASS_CNT];  /* Free blocks by class. */
+static uint8_t *pool_next, *pool_end;        /* Pages not handed out yet. */
+static struct arena *free_runs;              /* Freed runs. */
+
+/* Moves the break up by PAGE_CNT pages and returns the first one, or
+   a null pointer if the heap cannot grow. */
+static void *
+heap_grow (size_t page_cnt) {
+	uintptr_t brk = (uintptr_t) sbrk (0);
+	uint8_t *p;
+
+	/* Arenas must start on a page boundary. */
+	if (brk % PGSIZE != 0
+			&& sbrk (PGSIZE - brk % PGSIZE) == (void *) -1)
+		return NULL;
+	p = sbrk (page_cnt * PGSIZE);
+	return p != (void *) -1 ? p : NULL;
+}
+
+/* Returns a page from the pool, refilling it if empty, or a null
+   pointer if memory is exhausted. */
+static void *
+pool_get (void) {
+	if (pool_next == pool_end) {
+		size_t cnt = POOL_BATCH;
+		uint8_t *p;
+
+		/* Near the end of memory, take what is left. */
+		while ((p = heap_grow (cnt)) == NULL)
+			if ((cnt /= 2) == 0)
+				return NULL;
+		pool_next = p;
+		pool_end = p + cnt * PGSIZE;
+	}
+	pool_next += PGSIZE;
+	return pool_next - PGSIZE;
+}
+
+/* Returns the size class for SIZE bytes, or -1 if too big. */
+static int
+size_class (size_t size) {
+	int class;
+
+	for (class = 0; class < CLASS_CNT; class++)
+		if (size <= (size_t) MIN_SIZE << class)
+			return class;
+	return -1;
+}
+
+/* Returns the arena that block B lies in. */
+static struct arena *
+block_to_arena (void *b) {
+	struct arena *a = (struct arena *) ((uintptr_t) b / PGSIZE * PGSIZE);
+
+	ASSERT (a->magic == ARENA_MAGIC);
+	return a;
+}
+
+/* Divides a new arena into blocks of CLASS and puts them all on the
+   free list.  Returns false if memory is exhausted. */
+static bool
+refill (int class) {
+	size_t size = (size_t) MIN_SIZE << class;
+	struct arena *a = pool_get ();
+	uint8_t *b;
+
+	if (a == NULL)
+		return false;
+	a->magic = ARENA_MAGIC;
+	a->class = class;
+	for (b = (uint8_t *) a + ARENA_HDR; b + size <= (uint8_t *) a + PGSIZE;
+			b += size) {
+		struct block *block = (struct block *) b;
+
+		block->next = free_lists[class];
+		free_lists[class] = block;
+	}
+	return true;
+}
+
+/* Returns a run of pages for a block of SIZE bytes. */
+static void *
+run_alloc (size_t size) {
+	size_t page_cnt = DIV_ROUND_UP (size + ARENA_HDR, PGSIZE);
+	struct arena **ap, *a;
+
+	/* First fit among the freed runs. */
+	for (ap = &free_runs; *ap != NULL; ap = &(*ap)->next)
+		if ((*ap)->page_cnt >= page_cnt) {
+			a = *ap;
+			*ap = a->next;
+			return (uint8_t *) a + ARENA_HDR;
+		}
+
+	a = heap_grow (page_cnt);
+	if (a == NULL)
+		return NULL;
+	a->magic = ARENA_MAGIC;
+	a->class = -1;
+	a->page_cnt = page_cnt;
+	return (uint8_t *) a + ARENA_HDR;
+}
+
+/* Frees run A. */
+static void
+run_free (struct arena *a) {
+	size_t size = a->page_cnt * PGSIZE;
+
+	if ((uint8_t *) a + size == sbrk (0))
+		sbrk (-(intptr_t) size);
+	else {
+		a->next = free_runs;
+		free_runs = a;
+	}
+}
+
+/* Obtains and returns a new block of at least SIZE bytes.
+   Returns a null pointer if memory is not available. */
+void *
+malloc (size_t size) {
+	int class;
+	struct block *b;
+
+	if (size == 0)
+		return NULL;
+
+	class = size_class (size);
+	if (class < 0)
+		return run_alloc (size);
+
+	if (free_lists[class] == NULL && !refill (class))
+		return NULL;
+	b = free_lists[class];
+	free_lists[class] = b->next;
+	return b;
+}
+
+/* Allocates and return A times B bytes initialized to zeroes.
+   Returns a null pointer if memory is not available. */
+void *
+calloc (size_t a, size_t b) {
+	void *p;
+	size_t size;
+
+	/* Calculate block size and make sure it fits in size_t. */
+	size = a * b;
+	if (size < a || size < b)
+		return NULL;
+
+	p = malloc (size);
+	if (p != NULL)
+		memset (p, 0, size);
+	return p;
+}
+
+/* Returns the number of bytes allocated for BLOCK. */
+static size_t
+block_size (void *block) {
+	struct arena *a = block_to_arena (block);
+
+	return a->class >= 0 ? (size_t) MIN_SIZE << a->class
+		: a->page_cnt * PGSIZE - ARENA_HDR;
+}
+
+/* Attempts to resize OLD_BLOCK to NEW_SIZE bytes, possibly moving
+   it in the process.  If successful, returns the new block; on
+   failure, returns a null pointer.  A call with null OLD_BLOCK is
+   equivalent to malloc(NEW_SIZE).  A call with zero NEW_SIZE is
+   equivalent to free(OLD_BLOCK). */
+void *
+realloc (void *old_block, size_t new_size) {
+	size_t old_size;
+	void *new_block;
+
+	if (new_size == 0) {
+		free (old_block);
+		return NULL;
+	}
+	if (old_block == NULL)
+		return malloc (new_size);
+
+	/* Still fits: nothing to do. */
+	old_size = block_size (old_block);
+	if (new_size <= old_size)
+		return old_block;
+
+	new_block = malloc (new_size);
+	if (new_block != NULL) {
+		memcpy (new_block, old_block, old_size);
+		free (old_block);
+	}
+	return new_block;
+}
+
+/* Frees block P, which must have been previously allocated with
+   malloc(), calloc(), or realloc(). */
+void
+free (void *p) {
+	struct arena *a;
+	struct block *b = p;
+
+	if (p == NULL)
+		return;
+
+	a = block_to_arena (p);
+	if (a->class < 0) {
+		run_free (a);
+		return;
+	}
+	b->next = free_lists[a->class];
+	free_lists[a->class] = b;
+}
@@ -0,0 +1,35 @@
+/* Checks that getrusage() counts the faults that load anonymous
+   pages and reports them as resident. */
+
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define PAGE_SIZE 4096
+#define CHUNK_PAGE_COUNT 4
+
+static char buf[CHUNK_PAGE_COUNT * PAGE_SIZE];
+
+void
+test_main (void)
+{
+	struct rusage before, after;
+	size_t i;
+
+	CHECK (getrusage (&before) == 0, "getrusage");
+	for (i = 0; i < CHUNK_PAGE_COUNT; i++)
+		buf[i * PAGE_SIZE] = i;
+	CHECK (getrusage (&after) == 0, "getrusage");
+
+	if (after.minor_faults + after.major_faults
+			< before.minor_faults + before.major_faults + CHUNK_PAGE_COUNT)
+		fail ("%lld faults counted for %d new pages",
+				after.minor_faults + after.major_faults
+				- before.minor_faults - before.major_faults, CHUNK_PAGE_COUNT);
+	if (after.resident_anon < before.resident_anon + CHUNK_PAGE_COUNT)
+		fail ("%lld anonymous pages resident, expected at least %lld",
+				after.resident_anon, before.resident_anon + CHUNK_PAGE_COUNT);
+	if (after.fault_cycles <= before.fault_cycles)
+		fail ("no time spent in faults");
+	msg ("counters updated");
+}
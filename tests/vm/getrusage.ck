@@ -0,0 +1,12 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(getrusage) begin
+(getrusage) getrusage
+(getrusage) getrusage
+(getrusage) counters updated
+(getrusage) end
+EOF
+pass;
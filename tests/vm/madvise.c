@@ -0,0 +1,34 @@
+/* Checks that MADV_DONTNEED throws away anonymous contents, that
+   MADV_WILLNEED and MADV_SEQUENTIAL keep them, and that advice on
+   unmapped memory fails. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define PAGE_SIZE 4096
+#define CHUNK_PAGE_COUNT 4
+
+static char buf[CHUNK_PAGE_COUNT * PAGE_SIZE] __attribute__ ((aligned (PAGE_SIZE)));
+
+void
+test_main (void)
+{
+	size_t i;
+
+	memset (buf, 'a', sizeof buf);
+	CHECK (madvise (buf, sizeof buf, MADV_SEQUENTIAL) == 0, "madvise sequential");
+	CHECK (madvise (buf, sizeof buf, MADV_WILLNEED) == 0, "madvise willneed");
+	for (i = 0; i < sizeof buf; i++)
+		if (buf[i] != 'a')
+			fail ("byte %zu changed to %d", i, buf[i]);
+
+	CHECK (madvise (buf, sizeof buf, MADV_DONTNEED) == 0, "madvise dontneed");
+	for (i = 0; i < sizeof buf; i++)
+		if (buf[i] != 0)
+			fail ("byte %zu is %d after MADV_DONTNEED", i, buf[i]);
+
+	CHECK (madvise ((void *) 0x10000000, PAGE_SIZE, MADV_DONTNEED) == -1,
+			"madvise on unmapped memory fails");
+}
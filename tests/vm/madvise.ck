@@ -0,0 +1,13 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(madvise) begin
+(madvise) madvise sequential
+(madvise) madvise willneed
+(madvise) madvise dontneed
+(madvise) madvise on unmapped memory fails
+(madvise) end
+EOF
+pass;
@@ -0,0 +1,87 @@
+/* Allocation benchmark for the user-level malloc().  Runs a fixed,
+   pseudo-random mix of malloc(), realloc() and free() calls over
+   mostly small and some multi-page blocks, checking that no block
+   is corrupted along the way.  Run it with -vmstat to see what the
+   heap costs in faults. */
+
+#include <malloc.h>
+#include <random.h>
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define SLOT_CNT 512
+#define OP_CNT 50000
+
+static char *slots[SLOT_CNT];
+static size_t sizes[SLOT_CNT];
+
+/* Returns the size of a new block: mostly small, a few big. */
+static size_t
+pick_size (void)
+{
+	unsigned long r = random_ulong ();
+
+	if (r % 64 == 0)
+		return 2048 + r / 64 % (3 * 4096);
+	return 1 + r / 64 % 256;
+}
+
+/* Checks that slot I still holds its fill byte. */
+static void
+check_slot (size_t i)
+{
+	size_t j;
+
+	for (j = 0; j < sizes[i]; j++)
+		if (slots[i][j] != (char) i)
+			fail ("block %zu corrupted at byte %zu", i, j);
+}
+
+void
+test_main (void)
+{
+	size_t op, i, live = 0, peak = 0;
+	char *heap = sbrk (0);
+
+	random_init (0);
+	msg ("run %d operations on %d slots", OP_CNT, SLOT_CNT);
+	for (op = 0; op < OP_CNT; op++) {
+		i = random_ulong () % SLOT_CNT;
+		if (slots[i] == NULL) {
+			sizes[i] = pick_size ();
+			if ((slots[i] = malloc (sizes[i])) == NULL)
+				fail ("malloc (%zu) failed", sizes[i]);
+			memset (slots[i], i, sizes[i]);
+			if (++live > peak)
+				peak = live;
+		} else if (random_ulong () % 4 == 0) {
+			size_t old = sizes[i];
+
+			check_slot (i);
+			sizes[i] = pick_size ();
+			if ((slots[i] = realloc (slots[i], sizes[i])) == NULL)
+				fail ("realloc (%zu) failed", sizes[i]);
+			if (sizes[i] > old)
+				memset (slots[i] + old, i, sizes[i] - old);
+		} else {
+			check_slot (i);
+			free (slots[i]);
+			slots[i] = NULL;
+			live--;
+		}
+	}
+
+	for (i = 0; i < SLOT_CNT; i++) {
+		if (slots[i] != NULL)
+			check_slot (i);
+		free (slots[i]);
+	}
+	msg ("all blocks intact");
+
+	if ((char *) sbrk (0) - heap > SLOT_CNT * 4 * 4096)
+		fail ("heap grew to %zu bytes for %zu live blocks",
+				(size_t) ((char *) sbrk (0) - heap), peak);
+	msg ("heap stayed bounded");
+}
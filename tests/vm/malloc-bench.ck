@@ -0,0 +1,12 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(malloc-bench) begin
+(malloc-bench) run 50000 operations on 512 slots
+(malloc-bench) all blocks intact
+(malloc-bench) heap stayed bounded
+(malloc-bench) end
+EOF
+pass;
@@ -0,0 +1,38 @@
+/* Maps anonymous memory, checks that it reads as zeros and keeps
+   what is written, that it cannot be mapped twice, and that it is
+   inaccessible after munmap(). */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define ACTUAL ((char *) 0x10000000)
+#define MAP_SIZE 0x5000
+
+void
+test_main (void)
+{
+	char *map;
+	size_t i;
+
+	CHECK ((map = mmap (ACTUAL, MAP_SIZE, 1, MAP_ANON, 0)) != MAP_FAILED,
+			"mmap anonymous memory");
+	for (i = 0; i < MAP_SIZE; i++)
+		if (map[i] != 0)
+			fail ("byte %zu is %d, not 0", i, map[i]);
+	memset (map, 'a', MAP_SIZE);
+	for (i = 0; i < MAP_SIZE; i++)
+		if (map[i] != 'a')
+			fail ("byte %zu is %d, not 'a'", i, map[i]);
+	msg ("memory keeps what is written");
+
+	CHECK (mmap (ACTUAL + 0x1000, 0x1000, 1, MAP_ANON, 0) == MAP_FAILED,
+			"overlapping mmap fails");
+	CHECK (mmap (ACTUAL + MAP_SIZE, 0x1000, 1, MAP_ANON, 0x1000) == MAP_FAILED,
+			"anonymous mmap with an offset fails");
+
+	munmap (map);
+
+	fail ("unmapped memory is readable (%d)", map[0x1000]);
+}
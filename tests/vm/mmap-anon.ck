@@ -0,0 +1,13 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(mmap-anon) begin
+(mmap-anon) mmap anonymous memory
+(mmap-anon) memory keeps what is written
+(mmap-anon) overlapping mmap fails
+(mmap-anon) anonymous mmap with an offset fails
+mmap-anon: exit(-1)
+EOF
+pass;
@@ -0,0 +1,35 @@
+/* Writes to a file through a mapping, flushes it with msync()
+   while still mapped, and reads the data back through a second
+   file descriptor to verify. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/vm/sample.inc"
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define ACTUAL ((void *) 0x10000000)
+
+void
+test_main (void)
+{
+  int handle, handle2;
+  void *map;
+  char buf[1024];
+
+  CHECK (create ("sample.txt", strlen (sample)), "create \"sample.txt\"");
+  CHECK ((handle = open ("sample.txt")) > 1, "open \"sample.txt\"");
+  CHECK ((map = mmap (ACTUAL, 4096, 1, handle, 0)) != MAP_FAILED, "mmap \"sample.txt\"");
+  memcpy (ACTUAL, sample, strlen (sample));
+  CHECK (msync (map, 4096, MS_ASYNC | MS_SYNC) == -1, "msync with both flags fails");
+  CHECK (msync (map, 4096, MS_SYNC) == 0, "msync \"sample.txt\"");
+
+  /* Read back via read() while the mapping is still there. */
+  CHECK ((handle2 = open ("sample.txt")) > 1, "open \"sample.txt\" again");
+  read (handle2, buf, strlen (sample));
+  CHECK (!memcmp (buf, sample, strlen (sample)),
+         "compare read data against written data");
+  close (handle2);
+  munmap (map);
+  close (handle);
+}
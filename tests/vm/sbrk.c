@@ -0,0 +1,45 @@
+/* Grows the heap with sbrk(), checks that new memory reads as zeros
+   and keeps what is written, then shrinks it and checks that memory
+   given back comes back as zeros. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define PAGE_SIZE 4096
+#define HEAP_PAGES 16
+#define HEAP_SIZE (HEAP_PAGES * PAGE_SIZE)
+#define STACK_TOP ((char *) 0x47480000)
+
+static void
+check_bytes (const char *p, size_t start, size_t end, char c)
+{
+	size_t i;
+
+	for (i = start; i < end; i++)
+		if (p[i] != c)
+			fail ("heap byte %zu is %d, not %d", i, p[i], c);
+}
+
+void
+test_main (void)
+{
+	char *heap = sbrk (0);
+
+	CHECK (sbrk (HEAP_SIZE) == heap, "grow heap by %d pages", HEAP_PAGES);
+	CHECK (sbrk (0) == heap + HEAP_SIZE, "break moved up");
+	check_bytes (heap, 0, HEAP_SIZE, 0);
+	memset (heap, 'h', HEAP_SIZE);
+
+	CHECK (sbrk (-HEAP_SIZE / 2) == heap + HEAP_SIZE, "shrink heap by half");
+	check_bytes (heap, 0, HEAP_SIZE / 2, 'h');
+	CHECK (sbrk (HEAP_SIZE / 2) == heap + HEAP_SIZE / 2, "grow heap again");
+	check_bytes (heap, HEAP_SIZE / 2, HEAP_SIZE, 0);
+
+	CHECK (sbrk (-HEAP_SIZE - 1) == (void *) -1,
+			"shrinking below the heap start fails");
+	CHECK (sbrk (STACK_TOP - heap) == (void *) -1,
+			"growing into the stack fails");
+	CHECK (sbrk (0) == heap + HEAP_SIZE, "break unchanged");
+}
@@ -0,0 +1,16 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(sbrk) begin
+(sbrk) grow heap by 16 pages
+(sbrk) break moved up
+(sbrk) shrink heap by half
+(sbrk) grow heap again
+(sbrk) shrinking below the heap start fails
+(sbrk) growing into the stack fails
+(sbrk) break unchanged
+(sbrk) end
+EOF
+pass;
@@ -286,8 +286,6 @@ process_exit (void) {
 	 * TODO: We recommend you to implement process resource cleanup here. */
 	// printf("%s: exit(%d)\n", thread_current()->name, thread_current()->exit_status);
 	// 프로세스 종료 시 프로세스에 열려있는 모든 파일 닫기
-	file_close(curr->run_file);
-
 	struct list_elem *child;
     for (child = list_begin(&thread_current()->child_list); // childs 순회
          child != list_end(&thread_current()->child_list); child = list_next(child))
@@ -301,8 +299,15 @@ process_exit (void) {
 			file_close(curr->fd_table[i]);
 	}
 
+#ifdef VM
+	if (vmstat_on_exit && curr->pml4 != NULL)
+		spt_print_stats(&curr->spt, curr->name);
+#endif
 	process_cleanup ();
 
+	/* The text pages refer to the executable until they are gone. */
+	file_close(curr->run_file);
+
 	sema_up(&thread_current()->sema_wait);
 	sema_down(&thread_current()->sema_exit);
 	// 자식 프로세스 디스크립터 삭제
@@ -505,6 +510,11 @@ load (const char *file_name, struct intr_frame *if_) {
 					if (!load_segment (file, file_page, (void *) mem_page,
 								read_bytes, zero_bytes, writable))
 						goto done;
+#ifdef VM
+					/* The heap starts past the highest segment. */
+					if ((void *) (mem_page + read_bytes + zero_bytes) > t->spt.heap_start)
+						t->spt.heap_start = (void *) (mem_page + read_bytes + zero_bytes);
+#endif
 				}
 				else
 					goto done;
@@ -512,6 +522,10 @@ load (const char *file_name, struct intr_frame *if_) {
 		}
 	}
 
+#ifdef VM
+	t->spt.brk = t->spt.heap_start;
+#endif
+
 	/* Set up stack. */
 	if (!setup_stack (if_))
 		goto done;
@@ -731,30 +745,6 @@ install_page (void *upage, void *kpage, bool writable) {
  * If you want to implement the function for only project 2, implement it on the
  * upper block. */
 
-static bool
-lazy_load_segment (struct page *page, void *aux) {
-	/* TODO: Load the segment from the file */
-	/* TODO: This called when the first page fault occurs on address VA. */
-	/* TODO: VA is available when calling this function. */
-	/* 파일에서 세그먼트를 로드합니다. */
-	/* VA에 대한 첫 번째 페이지 폴트가 발생할 때 호출됩니다. */
-	/* 이 함수를 호출할 때 VA를 사용할 수 있습니다. */
-	struct load_segment_aux *con = aux;
-
-	// 파일로부터 con->read_bytes만큼 데이터를 읽어 페이지 프레임에 씁니다.
-	if (file_read_at(con->file, page->frame->kva, con->read_bytes, con->ofs) != con->read_bytes)
-	{
-		// 파일에서 읽기 도중 오류가 발생하면 false를 반환합니다.
-		return false;
-	}
-
-	// 페이지에 남은 부분은 0으로 초기화합니다.
-	memset(page->frame->kva + con->read_bytes, 0, con->zero_bytes);
-
-	// 세그먼트를 성공적으로 로드했으므로 true를 반환합니다.
-	return true;
-}
-
 /* Loads a segment starting at offset OFS in FILE at address
  * UPAGE.  In total, READ_BYTES + ZERO_BYTES bytes of virtual
  * memory are initialized, as follows:
@@ -776,30 +766,21 @@ load_segment (struct file *file, off_t ofs, uint8_t *upage,
 	ASSERT (pg_ofs (upage) == 0);
 	ASSERT (ofs % PGSIZE == 0);
 
-	while (read_bytes > 0 || zero_bytes > 0) {
-		/* Do calculate how to fill this page.
-		 * We will read PAGE_READ_BYTES bytes from FILE
-		 * and zero the final PAGE_ZERO_BYTES bytes. */
-		size_t page_read_bytes = read_bytes < PGSIZE ? read_bytes : PGSIZE;
-		size_t page_zero_bytes = PGSIZE - page_read_bytes;
-
-		/* TODO: Set up aux to pass information to the lazy_load_segment. */
-		struct load_segment_aux *aux = (struct load_segment_aux *)malloc(sizeof(struct load_segment_aux));
-		aux->file = file;
-		aux->ofs = ofs;
-		aux->read_bytes = page_read_bytes;
-		aux->zero_bytes = page_zero_bytes;
-
-		if (!vm_alloc_page_with_initializer (VM_ANON, upage,
-					writable, lazy_load_segment, aux)) {
-			return false;
-		}
+	/* The segment becomes one region; its pages are made from it on
+	 * first touch.  Pages past READ_BYTES (.bss) are plain zero-fill
+	 * pages: reads map the zero page until the first write.
+	 * Read-only segments are text: shared through the text cache and
+	 * read again from the file after eviction. */
+	struct file *seg_file = file_reopen (file);
 
-		/* Advance. */
-		read_bytes -= page_read_bytes;
-		zero_bytes -= page_zero_bytes;
-		upage += PGSIZE;
-		ofs += page_read_bytes; 
+	if (seg_file == NULL)
+		return false;
+	if (vma_create (&thread_current ()->spt.vmas, upage,
+				upage + read_bytes + zero_bytes,
+				writable ? VM_ANON : VM_FILE | VM_TEXT, writable,
+				seg_file, ofs, read_bytes) == NULL) {
+		file_close (seg_file);
+		return false;
 	}
 	return true;
 }
@@ -814,6 +795,11 @@ setup_stack (struct intr_frame *if_) {
      * TODO: If success, set the rsp accordingly.
      * TODO: You should mark the page is stack. */
     /* TODO: Your code goes here */
+    // 스택도 영역이다. 아래로 자랄 때 vm_stack_growth가 늘린다.
+    if (!vma_create(&thread_current()->spt.vmas, stack_bottom, (void *) USER_STACK,
+                VM_ANON, true, NULL, 0, 0))
+        return success;
+
     if (!vm_alloc_page(VM_ANON | VM_MARKER_0, stack_bottom, 1))
         return success;
 
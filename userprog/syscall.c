@@ -138,6 +138,20 @@ syscall_handler (struct intr_frame *f) {
 		case SYS_MUNMAP:
 			munmap(f->R.rdi);
 			break;
+#ifdef VM
+		case SYS_GETRUSAGE:
+			f->R.rax = getrusage((struct rusage *) f->R.rdi);
+			break;
+		case SYS_MSYNC:
+			f->R.rax = msync((void *) f->R.rdi, f->R.rsi, f->R.rdx);
+			break;
+		case SYS_MADVISE:
+			f->R.rax = madvise((void *) f->R.rdi, f->R.rsi, f->R.rdx);
+			break;
+		case SYS_SBRK:
+			f->R.rax = (uint64_t) sbrk(f->R.rdi);
+			break;
+#endif
 		default:
 			thread_exit ();
 	}
@@ -349,14 +363,23 @@ close (int fd) {
 
 void *
 mmap (void *addr, size_t length, int writable, int fd, off_t offset) {
+#ifdef VM
+	// 익명 매핑: 파일 없이 0으로 채워진 메모리
+	if (fd == MAP_ANON) {
+		if (!addr || addr != pg_round_down(addr) || offset != 0 || (long) length <= 0
+				|| is_kernel_vaddr(addr) || is_kernel_vaddr(addr + length))
+			return NULL;
+		if (vma_overlaps(&thread_current()->spt.vmas, addr, pg_round_up(addr + length)))
+			return NULL;
+		return do_mmap(addr, length, writable, NULL, 0);
+	}
+#endif
 	if (filesize(fd) <= 0 || length <= 0)
 		return NULL;
 	if (fd == 0 || fd == 1) // 표준 입출력 디스크립터 일 때
 		return NULL;
 	if (!addr || addr != pg_round_down(addr)) // addr이 페이지 정렬이 아닐 때
 		return NULL;
-	if (spt_find_page(&thread_current()->spt, addr)) // 기존에 매핑된 페이지랑 addr이 겹칠 때
-		return NULL;
 	if (offset != pg_round_down(offset) || offset % PGSIZE != 0)
         return NULL;
 
@@ -376,11 +399,9 @@ mmap (void *addr, size_t length, int writable, int fd, off_t offset) {
 	if (open_file == NULL || file_length(open_file) == 0 || (long)length <= 0)
 		return NULL;
 
-	// 기존에 매핑된 페이지와 겹치는지 확인
-    for (void *page_addr = addr; page_addr < end_addr; page_addr += PGSIZE) {
-        if (spt_find_page(&thread_current()->spt, page_addr))
-            return NULL;
-    }
+	// 기존 영역과 겹치는지 확인
+	if (vma_overlaps(&thread_current()->spt.vmas, addr, pg_round_up(end_addr)))
+		return NULL;
 		
 	return do_mmap(addr, length, writable, open_file, offset);
 }
@@ -388,4 +409,62 @@ mmap (void *addr, size_t length, int writable, int fd, off_t offset) {
 void
 munmap (void *addr) {
 	do_munmap(addr);
-}
\ No newline at end of file
+}
+
+#ifdef VM
+int
+getrusage (struct rusage *usage) {
+	struct supplemental_page_table *spt = &thread_current()->spt;
+	struct rusage ru;
+	size_t anon, file;
+
+	check_valid_buffer(usage, sizeof *usage, true);
+
+	// 복사 중의 fault가 값에 섞이지 않도록 먼저 모아 둔다.
+	spt_resident(spt, &anon, &file);
+	ru.minor_faults = spt->stats.minor_faults;
+	ru.major_faults = spt->stats.major_faults;
+	ru.stack_faults = spt->stats.stack_faults;
+	ru.swap_ins = spt->stats.swap_ins;
+	ru.swap_outs = spt->stats.swap_outs;
+	ru.cow_breaks = spt->stats.cow_breaks;
+	ru.resident_anon = anon;
+	ru.resident_file = file;
+	ru.fault_cycles = spt->stats.fault_cycles;
+	memcpy(usage, &ru, sizeof ru);
+	return 0;
+}
+
+int
+msync (void *addr, size_t length, int flags) {
+	if (addr != pg_round_down(addr) || addr + length < addr
+			|| is_kernel_vaddr(addr + length))
+		return -1;
+	if (flags != MS_ASYNC && flags != MS_SYNC)
+		return -1;
+	return do_msync(addr, length, flags == MS_SYNC) ? 0 : -1;
+}
+
+int
+madvise (void *addr, size_t length, int advice) {
+	enum vm_advice vm_advice;
+
+	if (addr != pg_round_down(addr) || addr + length < addr
+			|| is_kernel_vaddr(addr + length))
+		return -1;
+	switch (advice) {
+		case MADV_NORMAL: vm_advice = VM_ADVICE_NORMAL; break;
+		case MADV_SEQUENTIAL: vm_advice = VM_ADVICE_SEQUENTIAL; break;
+		case MADV_WILLNEED: vm_advice = VM_ADVICE_WILLNEED; break;
+		case MADV_DONTNEED: vm_advice = VM_ADVICE_DONTNEED; break;
+		case MADV_FREE: vm_advice = VM_ADVICE_FREE; break;
+		default: return -1;
+	}
+	return vm_madvise(addr, length, vm_advice) ? 0 : -1;
+}
+
+void *
+sbrk (intptr_t increment) {
+	return vm_sbrk(increment);
+}
+#endif
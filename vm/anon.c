@@ -1,11 +1,17 @@
 /* anon.c: Implementation of page for non-disk image (a.k.a. anonymous page). */
 #include <bitmap.h>
+#include <hash.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
 #include "vm/vm.h"
-#include "devices/disk.h"
+#include "vm/swap.h"
+#include "vm/zswap.h"
+#include "threads/malloc.h"
+#include "threads/synch.h"
 #include "include/threads/mmu.h"
 
 /* DO NOT MODIFY BELOW LINE */
-static struct disk *swap_disk;
 static bool anon_swap_in (struct page *page, void *kva);
 static bool anon_swap_out (struct page *page);
 static void anon_destroy (struct page *page);
@@ -18,16 +24,67 @@ static const struct page_operations anon_ops = {
 	.type = VM_ANON,
 };
 
-struct bitmap *swap_table;
-size_t slot_max;
+/* Serializes swap slot allocation, the swap cache and swap_buf. */
+static struct lock swap_lock;
+
+/* Owner (pml4) of each allocated slot.  Swap-in readahead only
+ * pulls in slots that belong to the faulting process. */
+static void **swap_owner;
+
+/* Bounce buffer for one cluster, so that a whole cluster moves
+ * with a single disk command. */
+static uint8_t *swap_buf;
+
+/* Swap cache: in-memory contents of swap slots, so that a slot is
+ * read from disk at most once.  An entry is either
+ *
+ * - a copy of a slot read ahead on swap-in, waiting for its page to
+ *   fault, or
+ *
+ * - the frame of a page that was swapped in from a slot that other
+ *   pages still hold, as after a fork.  Those pages map the frame
+ *   read-only when they fault, and share it until one writes it.
+ *
+ * A slot stays allocated while it is cached, and its entry goes
+ * when the last page holding the slot lets go of it. */
+struct swap_cache_entry {
+	struct hash_elem hash_elem;   /* Element in swap_cache. */
+	struct list_elem list_elem;   /* Element in swap_cache_fifo. */
+	size_t slot;                  /* Swap slot this is a copy of. */
+	void *kva;                    /* Kernel page holding the copy. */
+	struct frame *frame;          /* Or frame holding it, if not NULL. */
+};
+
+/* Most read-ahead copies the swap cache holds before dropping the
+ * oldest.  Frames do not count: they cost no extra memory. */
+#define SWAP_CACHE_MAX 64
+
+static struct hash swap_cache;
+static struct list swap_cache_fifo;   /* Oldest copy at the front. */
+static size_t swap_cache_copies;      /* Copies on swap_cache_fifo. */
+
+/* Statistics. */
+static uint64_t swap_cache_share_cnt; /* Faults that mapped a cached frame. */
+static uint64_t swap_fork_cnt;        /* Slots shared by fork. */
+
+static uint64_t swap_cache_hash (const struct hash_elem *e, void *aux UNUSED);
+static bool swap_cache_less (const struct hash_elem *a,
+		const struct hash_elem *b, void *aux UNUSED);
 
 /* Initialize the data for anonymous pages */
 void
 vm_anon_init (void) {
 	/* TODO: Set up the swap_disk. */
-	swap_disk = disk_get(1, 1);
-    slot_max = disk_size(swap_disk) / SLOT_SIZE;
-    swap_table = bitmap_create(slot_max);
+	swap_init();
+	swap_owner = calloc(swap_slot_cnt() + 1, sizeof *swap_owner);
+	swap_buf = palloc_get_multiple(0, SWAP_CLUSTER);
+	if (swap_owner == NULL || swap_buf == NULL)
+		PANIC ("vm_anon_init: cannot set up swap");
+
+	lock_init(&swap_lock);
+	zswap_init();
+	hash_init(&swap_cache, swap_cache_hash, swap_cache_less, NULL);
+	list_init(&swap_cache_fifo);
 }
 
 /* Initialize the file mapping */
@@ -35,58 +92,411 @@ bool
 anon_initializer (struct page *page, enum vm_type type, void *kva) {
 	struct uninit_page *uninit = &page->uninit;
 	memset(uninit, 0, sizeof(struct uninit_page));
-	
+
 	/* Set up the handler */
 	page->operations = &anon_ops;
 
 	struct anon_page *anon_page = &page->anon;
 	anon_page->slot = BITMAP_ERROR;
+	anon_page->lazy_free = false;
 
 	return true;
 }
 
+static uint64_t
+swap_cache_hash (const struct hash_elem *e, void *aux UNUSED) {
+	const struct swap_cache_entry *entry =
+		hash_entry (e, struct swap_cache_entry, hash_elem);
+	return hash_bytes (&entry->slot, sizeof entry->slot);
+}
+
+static bool
+swap_cache_less (const struct hash_elem *a, const struct hash_elem *b,
+		void *aux UNUSED) {
+	return hash_entry (a, struct swap_cache_entry, hash_elem)->slot
+		< hash_entry (b, struct swap_cache_entry, hash_elem)->slot;
+}
+
+/* Returns the swap cache entry for SLOT, or NULL. */
+static struct swap_cache_entry *
+swap_cache_find (size_t slot) {
+	struct swap_cache_entry key;
+	struct hash_elem *e;
+
+	key.slot = slot;
+	e = hash_find (&swap_cache, &key.hash_elem);
+	return e != NULL ? hash_entry (e, struct swap_cache_entry, hash_elem) : NULL;
+}
+
+/* Removes ENTRY from the swap cache and frees it.  A cached frame
+ * stays with the pages that map it. */
+static void
+swap_cache_remove (struct swap_cache_entry *entry) {
+	hash_delete (&swap_cache, &entry->hash_elem);
+	if (entry->frame != NULL)
+		entry->frame->swap_entry = NULL;
+	else {
+		list_remove (&entry->list_elem);
+		swap_cache_copies--;
+		palloc_free_page (entry->kva);
+	}
+	free (entry);
+}
+
+/* Stores a copy of the page at SRC as the cached contents of SLOT.
+ * Readahead is only a hint, so failing to allocate is not an error. */
+static void
+swap_cache_insert (size_t slot, const void *src) {
+	struct swap_cache_entry *entry;
+
+	if (swap_cache_copies >= SWAP_CACHE_MAX) {
+		entry = list_entry (list_pop_front (&swap_cache_fifo),
+				struct swap_cache_entry, list_elem);
+		hash_delete (&swap_cache, &entry->hash_elem);
+		swap_cache_copies--;
+	} else {
+		entry = malloc (sizeof *entry);
+		if (entry == NULL)
+			return;
+		entry->kva = palloc_get_page (0);
+		if (entry->kva == NULL) {
+			free (entry);
+			return;
+		}
+	}
+
+	entry->slot = slot;
+	entry->frame = NULL;
+	memcpy (entry->kva, src, PGSIZE);
+	hash_insert (&swap_cache, &entry->hash_elem);
+	list_push_back (&swap_cache_fifo, &entry->list_elem);
+	swap_cache_copies++;
+}
+
+/* Drops one page's reference to SLOT.  Once no page holds it, releases
+ * SLOT and anything cached for it. */
+static void
+slot_free (size_t slot) {
+	struct swap_cache_entry *entry;
+
+	if (!swap_slot_free (slot))
+		return;
+	entry = swap_cache_find (slot);
+	if (entry != NULL)
+		swap_cache_remove (entry);
+	zswap_invalidate (slot);
+	swap_owner[slot] = NULL;
+}
+
+/* Unmaps PAGE from its frame and points it at SLOT instead. */
+static void
+swap_unmap (struct page *page, size_t slot) {
+	pml4_clear_page (page->pml4, page->va);
+	page->anon.slot = slot;
+	page->stats->swap_outs++;
+	page->frame = NULL;
+}
+
+/* Moves every page that maps FRAME over to SLOT, each holding a
+ * reference to it, and copies FRAME's contents to DST.  FRAME is left
+ * linked to nothing, so that nobody looks at it once frame_lock is
+ * released. */
+static void
+swap_detach (size_t slot, struct frame *frame, void *dst) {
+	struct page *page = frame->page;
+
+	if (frame->swap_entry != NULL)
+		swap_cache_remove (frame->swap_entry);
+	swap_owner[slot] = page->pml4;
+	while (!list_empty (&frame->sharers)) {
+		swap_slot_dup (slot);
+		swap_unmap (list_entry (list_pop_front (&frame->sharers),
+					struct page, share_elem), slot);
+	}
+	swap_unmap (page, slot);
+	frame->page = NULL;
+
+	/* Copied only once unmapped, so that nobody modifies it meanwhile. */
+	memcpy (dst, frame->kva, PGSIZE);
+}
+
+/* Stores the CNT pages in swap_buf to SLOTS.  Pages that compress go
+ * to zswap; the rest are written with one disk command per run of
+ * consecutive slots. */
+static void
+swap_store (const size_t *slots, size_t cnt) {
+	bool stored[SWAP_CLUSTER];
+	size_t i, run;
+
+	for (i = 0; i < cnt; i++)
+		stored[i] = zswap_store (slots[i], swap_buf + i * PGSIZE);
+
+	for (i = 0; i < cnt; i = run) {
+		run = i + 1;
+		if (stored[i])
+			continue;
+		while (run < cnt && !stored[run] && slots[run] == slots[run - 1] + 1)
+			run++;
+		swap_write_slots (slots[i], run - i, swap_buf + i * PGSIZE);
+	}
+}
+
+/* Writes the oldest zswap entries back to their slots until the
+ * pool is within its budget. */
+static void
+zswap_shrink (void) {
+	size_t slot;
+
+	while (zswap_over_budget () && zswap_evict (&slot, swap_buf))
+		swap_write_slots (slot, 1, swap_buf);
+}
+
+/* Reads SLOT into KVA.  Following slots that belong to the same
+ * OWNER are read by the same disk command and kept in the swap
+ * cache, since pages that were evicted together tend to be
+ * needed together. */
+static void
+swap_read_ahead (size_t slot, void *owner, void *kva) {
+	size_t cnt = 1, limit = swap_slot_limit (slot), i;
+
+	/* A run read at once must not leave the area. */
+	while (cnt < SWAP_CLUSTER && slot + cnt < limit
+			&& swap_slot_refs (slot + cnt) > 0
+			&& swap_owner[slot + cnt] == owner
+			&& swap_cache_find (slot + cnt) == NULL
+			&& !zswap_contains (slot + cnt))
+		cnt++;
+
+	thread_current ()->spt.stats.fault_io = true;
+	swap_read_slots (slot, cnt, swap_buf);
+	memcpy (kva, swap_buf, PGSIZE);
+	for (i = 1; i < cnt; i++)
+		swap_cache_insert (slot + i, swap_buf + i * PGSIZE);
+}
+
 /* Swap in the page by read contents from the swap disk. */
 static bool
 anon_swap_in (struct page *page, void *kva) {
 	struct anon_page *anon_page = &page->anon;
+	struct swap_cache_entry *entry;
 
 	size_t slot = anon_page->slot;
-	size_t sector_num = slot * SLOT_SIZE;
-	if (slot == BITMAP_ERROR || !bitmap_test(swap_table, slot))
+	// 슬롯이 없으면 madvise나 회수로 버려진 페이지: 새 프레임은 0으로 차 있다.
+	if (slot == BITMAP_ERROR)
+		return true;
+	if (swap_slot_refs(slot) == 0)
 		return false;
 
-	// 스왑 디스크의 내용을 메모리로 읽는다.
-	for (int i = 0; i < SLOT_SIZE; i++)
-		disk_read(swap_disk, sector_num + i, kva + i * DISK_SECTOR_SIZE);
-	
-	bitmap_set(swap_table, slot, false);
-	
+	// 스왑 캐시나 zswap에 있으면 디스크를 읽지 않는다.
+	lock_acquire(&swap_lock);
+	entry = swap_cache_find(slot);
+	if (entry != NULL)
+		memcpy(kva, entry->frame != NULL ? entry->frame->kva : entry->kva, PGSIZE);
+	else if (!zswap_load(slot, kva))
+		swap_read_ahead(slot, page->pml4, kva);
+	// 다른 페이지도 이 슬롯을 들고 있으면 anon_swap_publish()가 프레임을 캐시에 올린 뒤 놓는다.
+	if (swap_slot_refs(slot) == 1) {
+		slot_free(slot);
+		anon_page->slot = BITMAP_ERROR;
+	}
+	lock_release(&swap_lock);
+
+	page->stats->swap_ins++;
 	return true;
 }
 
-/* Swap out the page by writing contents to the swap disk. */
+/* Called once PAGE has been swapped in.  If other pages still hold
+ * the slot it came from, puts PAGE's frame in the swap cache, mapped
+ * read-only, for them to share; then lets go of the slot. */
+void
+anon_swap_publish (struct page *page) {
+	struct anon_page *anon_page = &page->anon;
+	struct frame *frame = page->frame;
+	struct swap_cache_entry *entry;
+	size_t slot = anon_page->slot;
+
+	ASSERT (lock_held_by_current_thread (&frame_lock));
+
+	if (page_get_type (page) != VM_ANON || slot == BITMAP_ERROR)
+		return;
+
+	lock_acquire(&swap_lock);
+	entry = swap_cache_find(slot);
+	if (swap_slot_refs(slot) > 1 && frame->swap_entry == NULL
+			&& (entry == NULL || entry->frame == NULL)) {
+		if (entry != NULL)
+			swap_cache_remove(entry);
+		entry = malloc(sizeof *entry);
+		if (entry != NULL) {
+			entry->slot = slot;
+			entry->kva = NULL;
+			entry->frame = frame;
+			hash_insert(&swap_cache, &entry->hash_elem);
+			frame->swap_entry = entry;
+			frame->cow = true;
+			pml4_clear_page(page->pml4, page->va);
+			pml4_set_page(page->pml4, page->va, frame->kva, false);
+		}
+	}
+	slot_free(slot);
+	lock_release(&swap_lock);
+	anon_page->slot = BITMAP_ERROR;
+}
+
+/* Maps PAGE, which is swapped out, to the frame that already holds
+ * its slot's contents, if another page swapped it in.  Returns true
+ * if it did, in which case the fault is resolved. */
+bool
+anon_swap_map (struct page *page) {
+	struct anon_page *anon_page = &page->anon;
+	struct swap_cache_entry *entry;
+	bool mapped = false;
+
+	if (page_get_type (page) != VM_ANON || page->frame != NULL
+			|| anon_page->slot == BITMAP_ERROR)
+		return false;
+
+	lock_acquire (&frame_lock);
+	lock_acquire (&swap_lock);
+	entry = swap_cache_find (anon_page->slot);
+	if (entry != NULL && entry->frame != NULL) {
+		struct frame *frame = entry->frame;
+
+		page->frame = frame;
+		list_push_back (&frame->sharers, &page->share_elem);
+		pml4_set_page (page->pml4, page->va, frame->kva, false);
+		slot_free (anon_page->slot);
+		anon_page->slot = BITMAP_ERROR;
+		anon_page->lazy_free = false;
+		swap_cache_share_cnt++;
+		mapped = true;
+	}
+	lock_release (&swap_lock);
+	lock_release (&frame_lock);
+	return mapped;
+}
+
+/* Takes FRAME out of the swap cache, before it is freed, reused or
+ * written to: pages that still hold its slot read the slot again. */
+void
+anon_swap_forget (struct frame *frame) {
+	ASSERT (lock_held_by_current_thread (&frame_lock));
+
+	/* Frames join the swap cache only under frame_lock, so this need
+	 * not wait for swap_lock, which is held across swap writes. */
+	if (frame->swap_entry == NULL)
+		return;
+	lock_acquire (&swap_lock);
+	if (frame->swap_entry != NULL)
+		swap_cache_remove (frame->swap_entry);
+	lock_release (&swap_lock);
+}
+
+/* Makes DST, a new page of a child process, share the swap slot that
+ * holds the contents of SRC, which is swapped out, instead of reading
+ * SRC back in to copy it. */
+void
+anon_fork_swapped (struct page *dst, struct page *src) {
+	size_t slot = src->anon.slot;
+
+	ASSERT (src->frame == NULL && dst->frame == NULL);
+
+	anon_initializer (dst, VM_ANON, NULL);
+	if (slot == BITMAP_ERROR)
+		return;
+	lock_acquire (&swap_lock);
+	swap_slot_dup (slot);
+	swap_fork_cnt++;
+	lock_release (&swap_lock);
+	dst->anon.slot = slot;
+}
+
+void
+anon_print_stats (void) {
+	printf ("Swap cache: %"PRIu64" faults mapped a cached frame, "
+			"%"PRIu64" slots shared by fork\n",
+			swap_cache_share_cnt, swap_fork_cnt);
+}
+
+/* Swaps out the CNT anonymous frames in FRAMES, which must be off
+ * the LRU lists, writing them to one contiguous run of slots when one
+ * is free.  The pages that share a frame share its slot.  Returns the
+ * number of frames swapped out, which is less than CNT only if swap
+ * is full; those are the first frames in FRAMES, now detached.  The
+ * others, but for FRAMES[0], go back on the inactive list.
+ *
+ * The pages are detached under frame_lock, but compressed and written
+ * with only swap_lock held: a fault on one of them waits for swap_lock
+ * in anon_swap_in(), by which time its slot holds its contents. */
+size_t
+anon_swap_out_cluster (struct frame **frames, size_t cnt) {
+	size_t slots[SWAP_CLUSTER];
+	size_t slot, done = 0, i;
+
+	ASSERT (lock_held_by_current_thread (&frame_lock));
+	ASSERT (cnt > 0 && cnt <= SWAP_CLUSTER);
+
+	lock_acquire(&swap_lock);
+	slot = swap_slot_alloc(cnt);
+	if (slot != BITMAP_ERROR) {
+		for (; done < cnt; done++)
+			slots[done] = slot + done;
+	} else {
+		/* No run that long is left: fall back to single slots. */
+		for (; done < cnt; done++) {
+			slots[done] = swap_slot_alloc(1);
+			if (slots[done] == BITMAP_ERROR)
+				break;
+		}
+	}
+	for (i = 0; i < done; i++)
+		swap_detach(slots[i], frames[i], swap_buf + i * PGSIZE);
+	for (i = done > 0 ? done : 1; i < cnt; i++)
+		vm_frame_set_lru(frames[i], LRU_INACTIVE);
+	if (done == 0) {
+		lock_release(&swap_lock);
+		return 0;
+	}
+
+	lock_release(&frame_lock);
+	swap_store(slots, done);
+	zswap_shrink();
+	lock_release(&swap_lock);
+	lock_acquire(&frame_lock);
+	return done;
+}
+
+/* Swap out the page by writing contents to the swap disk, along with
+ * the pages that share its frame.  Releases frame_lock meanwhile. */
 static bool
 anon_swap_out (struct page *page) {
+	return anon_swap_out_cluster(&page->frame, 1) == 1;
+}
+
+/* Throws away the contents of PAGE, which reads as zeros afterwards.
+ * Returns PAGE's frame, unmapped and detached, for the caller to reuse
+ * or free, or NULL if there is none or other pages still map it. */
+struct frame *
+anon_drop (struct page *page) {
 	struct anon_page *anon_page = &page->anon;
+	struct frame *frame = page->frame;
+
+	ASSERT (lock_held_by_current_thread (&frame_lock));
 
-	// page에 연결된 프레임을 디스크로 옮긴다.
-	// 1. 스왑 테이블에서 옮길 수 있는 스왑 슬롯 찾기
-	size_t free_idx = bitmap_scan_and_flip(swap_table, 0, 1, false);
-	if (free_idx == BITMAP_ERROR)
-		return false; // 디스크에 여유 스왑 슬롯이 없으면 PANIC 
-	size_t sector_num = free_idx * SLOT_SIZE;
-	
-	// 2. 페이지의 데이터를 스왑 슬롯에 복사
-	for (int i = 0; i < SLOT_SIZE; i++)
-		disk_write(swap_disk, sector_num + i, page->frame->kva + i * DISK_SECTOR_SIZE);
-
-	anon_page->slot = free_idx;
-
-	// 3. pml4에서 page->va와 page->frame->kva의 연결을 끊는다.
-	page->frame->page = NULL;
+	if (anon_page->slot != BITMAP_ERROR) {
+		lock_acquire(&swap_lock);
+		slot_free(anon_page->slot);
+		lock_release(&swap_lock);
+		anon_page->slot = BITMAP_ERROR;
+	}
+	anon_page->lazy_free = false;
+
+	if (frame == NULL || vm_frame_unshare(page))
+		return NULL;
+	pml4_clear_page(page->pml4, page->va);
+	frame->page = NULL;
 	page->frame = NULL;
-	pml4_clear_page(thread_current()->pml4, page->va);
-	return true;
+	return frame;
 }
 
 /* Destroy the anonymous page. PAGE will be freed by the caller. */
@@ -94,14 +504,18 @@ static void
 anon_destroy (struct page *page) {
 	struct anon_page *anon_page = &page->anon;
 
-	if (anon_page->slot != BITMAP_ERROR)
-		bitmap_reset(swap_table, anon_page->slot);
+	if (anon_page->slot != BITMAP_ERROR) {
+		lock_acquire(&swap_lock);
+		slot_free(anon_page->slot);
+		lock_release(&swap_lock);
+		anon_page->slot = BITMAP_ERROR;
+	}
 
-	if (page->frame) {
-		list_remove(&page->frame->frame_elem);
-		palloc_free_page(page->frame->kva);
-		free(page->frame);
-		page->frame = NULL;
+	/* A merged frame stays as long as other pages map it. */
+	if (page->frame && !vm_frame_unshare(page)) {
+		page->frame->page = NULL;
+		vm_frame_free(page->frame);
 	}
+	page->frame = NULL;
 	pml4_clear_page(page->pml4, page->va);
 }
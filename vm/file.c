@@ -1,7 +1,13 @@
 /* file.c: Implementation of memory backed file object (mmaped object). */
 
+#include <hash.h>
+#include <inttypes.h>
+#include <stdio.h>
 #include <string.h>
 #include "vm/vm.h"
+#include "vm/writeback.h"
+#include "filesys/inode.h"
+#include "threads/malloc.h"
 #include "include/threads/vaddr.h"
 #include "include/threads/mmu.h"
 
@@ -9,11 +15,14 @@ static bool file_backed_swap_in (struct page *page, void *kva);
 static bool file_backed_swap_out (struct page *page);
 static void file_backed_destroy (struct page *page);
 
-static bool
+/* Loads the part of a file described by AUX, a struct load_segment_aux,
+ * into PAGE.  Used both for executable segments and for mmaps. */
+bool
 lazy_load_segment (struct page *page, void *aux) {
 	struct load_segment_aux *con = aux;
 
 	// 파일로부터 con->read_bytes만큼 데이터를 읽어 페이지 프레임에 씁니다.
+	page->stats->fault_io = true;
 	if (file_read_at(con->file, page->frame->kva, con->read_bytes, con->ofs) != con->read_bytes){
 		return false;
 	}
@@ -32,9 +41,213 @@ static const struct page_operations file_ops = {
 	.type = VM_FILE,
 };
 
+/* Text cache: frames holding read-only text of running executables,
+ * keyed by the part of the file they hold, so that every process
+ * running the same program maps the same frames.  The contents of a
+ * cached frame cannot go stale because each mapping process keeps the
+ * executable open with writes denied.  Protected by frame_lock. */
+struct text_entry {
+	struct hash_elem elem;        /* Element in text_cache. */
+	disk_sector_t inumber;        /* Inode of the executable. */
+	off_t ofs;                    /* Offset of the page in the file. */
+	uint32_t read_bytes;          /* Bytes read from the file. */
+	struct frame *frame;          /* Frame holding the page. */
+};
+
+static struct hash text_cache;
+static uint64_t text_share_cnt;   /* Faults served from the text cache. */
+static uint64_t cache_map_cnt;    /* Faults served from the page cache. */
+
+static uint64_t text_hash (const struct hash_elem *e, void *aux UNUSED);
+static bool text_less (const struct hash_elem *a, const struct hash_elem *b,
+		void *aux UNUSED);
+
 /* The initializer of file vm */
 void
 vm_file_init (void) {
+	hash_init (&text_cache, text_hash, text_less, NULL);
+	writeback_init ();
+}
+
+void
+file_print_stats (void) {
+	printf ("VM: %"PRIu64" text pages shared, %zu in text cache, "
+			"%"PRIu64" mapped pages from the page cache\n",
+			text_share_cnt, hash_size (&text_cache), cache_map_cnt);
+}
+
+static uint64_t
+text_hash (const struct hash_elem *e, void *aux UNUSED) {
+	const struct text_entry *t = hash_entry (e, struct text_entry, elem);
+	return hash_int (t->inumber) ^ hash_int (t->ofs);
+}
+
+static bool
+text_less (const struct hash_elem *a_, const struct hash_elem *b_,
+		void *aux UNUSED) {
+	const struct text_entry *a = hash_entry (a_, struct text_entry, elem);
+	const struct text_entry *b = hash_entry (b_, struct text_entry, elem);
+
+	if (a->inumber != b->inumber)
+		return a->inumber < b->inumber;
+	if (a->ofs != b->ofs)
+		return a->ofs < b->ofs;
+	return a->read_bytes < b->read_bytes;
+}
+
+/* Fills in the text cache key of PAGE.  Returns false if PAGE is not
+ * executable text, loaded or not. */
+static bool
+text_key (struct page *page, struct text_entry *key) {
+	struct file *file;
+
+	if (VM_TYPE (page->operations->type) == VM_UNINIT) {
+		struct load_segment_aux *aux = page->uninit.aux;
+
+		if (VM_TYPE (page->uninit.type) != VM_FILE
+				|| !(page->uninit.type & VM_TEXT))
+			return false;
+		file = aux->file;
+		key->ofs = aux->ofs;
+		key->read_bytes = aux->read_bytes;
+	} else if (page_get_type (page) == VM_FILE && page->file.text) {
+		file = page->file.file;
+		key->ofs = page->file.ofs;
+		key->read_bytes = page->file.read_bytes;
+	} else
+		return false;
+
+	key->inumber = inode_get_inumber (file_get_inode (file));
+	return true;
+}
+
+static struct text_entry *
+text_find (struct page *page) {
+	struct text_entry key;
+	struct hash_elem *e;
+
+	if (!text_key (page, &key))
+		return NULL;
+	e = hash_find (&text_cache, &key.elem);
+	return e != NULL ? hash_entry (e, struct text_entry, elem) : NULL;
+}
+
+/* Maps PAGE to the frame that already holds its contents, if PAGE is
+ * executable text that another process has loaded.  Returns true if
+ * it did, in which case the fault is resolved. */
+bool
+file_text_map (struct page *page) {
+	struct text_entry *t;
+
+	lock_acquire (&frame_lock);
+	t = text_find (page);
+	if (t != NULL) {
+		if (VM_TYPE (page->operations->type) == VM_UNINIT)
+			page->uninit.page_initializer (page, page->uninit.type,
+					t->frame->kva);
+		vm_frame_share (t->frame, page);
+		text_share_cnt++;
+	}
+	lock_release (&frame_lock);
+	return t != NULL;
+}
+
+/* Returns whether the READ_BYTES bytes of executable FILE at OFS are
+ * in the text cache. */
+bool
+file_text_cached (struct file *file, off_t ofs, uint32_t read_bytes) {
+	struct text_entry key;
+	bool cached;
+
+	key.inumber = inode_get_inumber (file_get_inode (file));
+	key.ofs = ofs;
+	key.read_bytes = read_bytes;
+	lock_acquire (&frame_lock);
+	cached = hash_find (&text_cache, &key.elem) != NULL;
+	lock_release (&frame_lock);
+	return cached;
+}
+
+/* Offers the frame of PAGE, which has just been loaded, to the other
+ * processes running the same executable.  Does nothing unless PAGE is
+ * executable text.  If two processes loaded the same page at once,
+ * the second one keeps its copy private. */
+void
+file_text_publish (struct page *page) {
+	struct text_entry *t;
+
+	ASSERT (lock_held_by_current_thread (&frame_lock));
+
+	if (page->frame->text != NULL || text_find (page) != NULL)
+		return;
+
+	t = malloc (sizeof *t);
+	if (t == NULL || !text_key (page, t)) {
+		free (t);
+		return;
+	}
+	t->frame = page->frame;
+	page->frame->text = t;
+	hash_insert (&text_cache, &t->elem);
+}
+
+/* Removes FRAME from the text cache, before it is freed or reused. */
+void
+file_text_forget (struct frame *frame) {
+	ASSERT (lock_held_by_current_thread (&frame_lock));
+
+	if (frame->text == NULL)
+		return;
+	hash_delete (&text_cache, &frame->text->elem);
+	free (frame->text);
+	frame->text = NULL;
+}
+
+/* Returns whether PAGE belongs to a file mapping made by mmap(),
+ * whose pages map the frames of the page cache. */
+bool
+file_cache_mapped (struct page *page) {
+	return page_cache_enabled && page_get_type (page) == VM_FILE
+		&& page->vma != NULL && page->vma->mapped;
+}
+
+/* Maps PAGE, a page of a file mapping without a frame, to the page
+ * cache's frame for the same part of the file, loading that first if
+ * needed.  Returns false if the page cannot be loaded. */
+bool
+file_cache_map (struct page *page) {
+	struct file *file;
+	struct frame *frame;
+	off_t ofs;
+
+	if (VM_TYPE (page->operations->type) == VM_UNINIT) {
+		struct load_segment_aux *aux = page->uninit.aux;
+
+		file = aux->file;
+		ofs = aux->ofs;
+	} else {
+		file = page->file.file;
+		ofs = page->file.ofs;
+	}
+
+	frame = page_cache_get (file_get_inode (file), ofs, true);
+	if (frame == NULL)
+		return false;
+	lock_acquire (&frame_lock);
+	if (VM_TYPE (page->operations->type) == VM_UNINIT)
+		page->uninit.page_initializer (page, page->uninit.type, frame->kva);
+	vm_frame_share (frame, page);
+	cache_map_cnt++;
+	lock_release (&frame_lock);
+	page_cache_put (frame, false);
+	return true;
+}
+
+/* Returns whether PAGE, which has a frame, maps a frame of the page
+ * cache. */
+static bool
+page_in_cache (struct page *page) {
+	return page_get_type (page->frame->page) == VM_PAGE_CACHE;
 }
 
 /* Initialize the file backed page */
@@ -51,6 +264,8 @@ file_backed_initializer (struct page *page, enum vm_type type, void *kva) {
 	file_page->ofs = load_segment_aux->ofs;
 	file_page->read_bytes = load_segment_aux->read_bytes;
 	file_page->zero_bytes = load_segment_aux->zero_bytes;
+	file_page->text = (type & VM_TEXT) != 0;
+	return true;
 }
 
 /* Swap in the page by read contents from the file. */
@@ -61,90 +276,135 @@ file_backed_swap_in (struct page *page, void *kva) {
 	return lazy_load_segment(page, (void *)file_page);
 }
 
-/* Swap out the page by writeback contents to the file. */
+/* Swap out the page by writeback contents to the file.  Only file
+ * mappings, which map page cache frames, can be dirty: text is
+ * read-only.  The page cache writes its own frames back. */
 static bool
 file_backed_swap_out (struct page *page) {
-	struct file_page *file_page UNUSED = &page->file;
-
 	if (page == NULL)
 		return false;
 	
+	pml4_clear_page(page->pml4, page->va);
 	if (pml4_is_dirty(page->pml4, page->va)) {
-		file_write_at(file_page->file, page->frame->kva, file_page->read_bytes, file_page->ofs);
+		ASSERT (page_in_cache(page));
+		page_cache_set_dirty(page->frame->page);
 		pml4_set_dirty(page->pml4, page->va, false);
 	}
-	page->frame->page = NULL;
+	if (page->frame->page == page)
+		page->frame->page = NULL;
+	else
+		list_remove(&page->share_elem);
 	page->frame = NULL;
-
-	pml4_clear_page(page->pml4, page->va);
+	return true;
 }
 
-/* Destory the file backed page. PAGE will be freed by the caller. */
+/* Destory the file backed page. PAGE will be freed by the caller.
+ * A mapping hands its dirty bit to the page cache, which writes the
+ * frame back later; text is never dirty. */
 static void
 file_backed_destroy (struct page *page) {
-	struct file_page *file_page UNUSED = &page->file;
-	if (pml4_is_dirty(page->pml4, page->va)) {
-		file_write_at(file_page->file, page->frame->kva, file_page->read_bytes, file_page->ofs);
-		pml4_set_dirty(page->pml4, page->va, false);
+	struct frame *frame = page->frame;
+
+	if (frame == NULL)
+		return;
+
+	if (page_in_cache(page)) {
+		if (pml4_is_dirty(page->pml4, page->va))
+			page_cache_set_dirty(frame->page);
+		vm_frame_unshare(page);
+		return;
 	}
-	pml4_clear_page(page->pml4, page->va);
+
+	ASSERT (!pml4_is_dirty(page->pml4, page->va));
+	/* Other processes may still map the frame. */
+	if (!vm_frame_unshare(page)) {
+		pml4_clear_page(page->pml4, page->va);
+		frame->page = NULL;
+		vm_frame_free(frame);
+	}
+	page->frame = NULL;
 }
 
 /* Do the mmap */
+/* 영역만 만들고, 페이지는 처음 닿을 때 영역에서 만든다.
+ * FILE이 NULL이면 0으로 채워진 익명 매핑이다. */
 void *
 do_mmap (void *addr, size_t length, int writable,
 		struct file *file, off_t offset) {
-	struct file *re_file = file_reopen(file);
-	size_t read_bytes = length > file_length(re_file) ? file_length(re_file) : length;
-	int page_cnt = length % PGSIZE ? length / PGSIZE + 1 : length / PGSIZE;
-	void *ret = addr;	
-	
+	struct file *re_file = NULL;
+	size_t read_bytes = 0;
+	struct vma *vma;
+
     ASSERT(pg_ofs(addr) == 0);      // upage가 페이지 정렬되어 있는지 확인
     ASSERT(offset % PGSIZE == 0); // ofs가 페이지 정렬되어 있는지 확인
 
-	while (read_bytes > 0) {
-		/* Do calculate how to fill this page.
-		 * We will read PAGE_READ_BYTES bytes from FILE
-		 * and zero the final PAGE_ZERO_BYTES bytes. */
-		size_t page_read_bytes = read_bytes < PGSIZE ? read_bytes : PGSIZE;
-		size_t page_zero_bytes = PGSIZE - page_read_bytes;
-
-		/* TODO: Set up aux to pass information to the lazy_load_segment. */
-		struct load_segment_aux *aux = (struct load_segment_aux *)malloc(sizeof(struct load_segment_aux));
-		if (!aux)
-			return NULL;
-		aux->file = re_file;
-		aux->ofs = offset;
-		aux->read_bytes = page_read_bytes;
-		aux->zero_bytes = page_zero_bytes;
+	if (file != NULL) {
+		off_t file_left;
 
-		if (!vm_alloc_page_with_initializer (VM_FILE, addr,
-					writable, lazy_load_segment, aux)) {
+		if ((re_file = file_reopen(file)) == NULL)
 			return NULL;
-		}
+		file_left = file_length(re_file) > offset ? file_length(re_file) - offset : 0;
+		read_bytes = length > (size_t) file_left ? (size_t) file_left : length;
+	}
 
-		/* Advance. */
-		
-		spt_find_page(&thread_current()->spt, addr)->page_cnt = page_cnt--;
-		read_bytes -= page_read_bytes;
-		addr += PGSIZE;
-		offset += page_read_bytes; 
+	vma = vma_create(&thread_current()->spt.vmas, addr, addr + (size_t) pg_round_up(length),
+			file != NULL ? VM_FILE : VM_ANON, writable, re_file, offset, read_bytes);
+	if (vma == NULL) {
+		file_close(re_file);
+		return NULL;
 	}
-	return ret;
+	vma->mapped = true;
+	return addr;
 }
 
 /* Do the munmap */
 void
 do_munmap (void *addr) {
-	struct page *upage = spt_find_page(&thread_current()->spt, addr);
-	int page_cnt = upage->page_cnt;
-	
-	for (int i = 0; i < page_cnt; i++) {
-		if (upage) {
-			destroy(upage);
-			// spt_remove_page(&thread_current()->spt, upage);
-		}
-		addr += PGSIZE;
-		upage = spt_find_page(&thread_current()->spt, addr);
+	struct supplemental_page_table *spt = &thread_current()->spt;
+	struct vma *vma = vma_find(&spt->vmas, addr);
+
+	// mmap으로 만든 영역의 시작 주소만 받는다.
+	if (vma == NULL || vma->start != addr || !vma->mapped)
+		return;
+
+	while (!list_empty(&vma->pages))
+		spt_remove_page(spt, list_entry(list_front(&vma->pages),
+					struct page, vma_elem));
+	vma_destroy(&spt->vmas, vma);
+}
+
+/* Queues the dirty file pages in [ADDR, ADDR + LENGTH) for writeback.
+ * With SYNC, returns only once they are in their files.  Returns false
+ * if part of the range is not mapped. */
+bool
+do_msync (void *addr, size_t length, bool sync) {
+	struct supplemental_page_table *spt = &thread_current()->spt;
+	struct vma *vma;
+	void *va;
+
+	if (!vma_covers(&spt->vmas, pg_round_down(addr), addr + length))
+		return false;
+
+	for (va = pg_round_down(addr); va < addr + length; va += PGSIZE) {
+		struct page *page = spt_find_page(spt, va);
+
+		// 아직 닿지 않은 페이지는 쓸 것이 없다.
+		if (page == NULL || VM_TYPE(page->operations->type) != VM_FILE)
+			continue;
+
+		// 매핑된 페이지는 모두 페이지 캐시의 프레임을 쓴다.
+		lock_acquire(&frame_lock);
+		if (page->frame != NULL && page_in_cache(page))
+			page_cache_queue(page->frame->page);
+		lock_release(&frame_lock);
 	}
+
+	// 같은 파일의 다른 쓰기도 기다리지만, 범위의 페이지는 모두 포함된다.
+	if (sync)
+		for (va = pg_round_down(addr); va < addr + length; va = vma->end) {
+			vma = vma_find(&spt->vmas, va);
+			if (vma->file != NULL)
+				writeback_wait(file_get_inode(vma->file));
+		}
+	return true;
 }
@@ -0,0 +1,203 @@
+/* ksm.c: Kernel same-page merging.
+ *
+ * A low-priority kernel thread looks at a few anonymous frames at a
+ * time and merges frames with identical contents, across processes,
+ * into a single read-only frame.  The first write to a merged page
+ * gets a private copy again through vm_handle_wp().
+ *
+ * Candidates are found through two trees keyed by a checksum of the
+ * contents.  The stable tree holds merged frames, whose contents
+ * cannot change.  The unstable tree holds frames seen during the
+ * current pass that had the same checksum in the previous pass, and
+ * is emptied when a pass ends.  Frames whose contents keep changing
+ * never get into either tree.  Both trees are protected by
+ * frame_lock. */
+
+#include "vm/ksm.h"
+#include <hash.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+#include "devices/timer.h"
+#include "threads/interrupt.h"
+#include "threads/mmu.h"
+#include "threads/thread.h"
+#include "vm/vm.h"
+
+/* Frames looked at per batch, and pause between batches. */
+#define KSM_PAGES_TO_SCAN 64
+#define KSM_SLEEP_MS 100
+
+bool ksm_enabled;
+
+static struct hash stable_tree;
+static struct hash unstable_tree;
+static unsigned ksm_pass = 1;        /* Frames start out at pass 0. */
+
+/* Statistics. */
+static uint64_t full_scan_cnt;
+static uint64_t merge_cnt;
+
+static void ksm_thread (void *aux UNUSED);
+
+static uint64_t
+ksm_hash (const struct hash_elem *e, void *aux UNUSED) {
+	return hash_entry (e, struct frame, ksm_elem)->ksm_sum;
+}
+
+static bool
+ksm_less (const struct hash_elem *a, const struct hash_elem *b,
+		void *aux UNUSED) {
+	return hash_entry (a, struct frame, ksm_elem)->ksm_sum
+		< hash_entry (b, struct frame, ksm_elem)->ksm_sum;
+}
+
+/* Starts the merging thread if -ksm was given. */
+void
+ksm_init (void) {
+	hash_init (&stable_tree, ksm_hash, ksm_less, NULL);
+	hash_init (&unstable_tree, ksm_hash, ksm_less, NULL);
+	if (ksm_enabled)
+		thread_create ("ksmd", PRI_MIN, ksm_thread, NULL);
+}
+
+/* Takes FRAME out of the KSM trees, before it is freed, reused or
+ * written to. */
+void
+ksm_forget (struct frame *frame) {
+	ASSERT (lock_held_by_current_thread (&frame_lock));
+
+	if (frame->ksm == KSM_STABLE)
+		hash_delete (&stable_tree, &frame->ksm_elem);
+	else if (frame->ksm == KSM_UNSTABLE)
+		hash_delete (&unstable_tree, &frame->ksm_elem);
+	frame->ksm = KSM_NONE;
+}
+
+void
+ksm_print_stats (void) {
+	struct hash_iterator i;
+	size_t sharing = 0;
+
+	if (!ksm_enabled)
+		return;
+
+	hash_first (&i, &stable_tree);
+	while (hash_next (&i))
+		sharing += list_size (&hash_entry (hash_cur (&i), struct frame,
+					ksm_elem)->sharers);
+	printf ("KSM: %zu pages shared, %zu pages saved, %"PRIu64" merges, "
+			"%"PRIu64" full scans\n",
+			hash_size (&stable_tree), sharing, merge_cnt, full_scan_cnt);
+}
+
+/* Returns the frame in TREE whose checksum is that of FRAME, or NULL. */
+static struct frame *
+ksm_lookup (struct hash *tree, struct frame *frame) {
+	struct hash_elem *e = hash_find (tree, &frame->ksm_elem);
+	return e != NULL ? hash_entry (e, struct frame, ksm_elem) : NULL;
+}
+
+/* Maps KVA read-only at PAGE.  The stale translation is flushed in
+ * case PAGE belongs to the running address space. */
+static void
+ksm_map_readonly (struct page *page, void *kva) {
+	pml4_clear_page (page->pml4, page->va);
+	pml4_set_page (page->pml4, page->va, kva, false);
+}
+
+/* If FRAME still holds the same contents as INTO, maps INTO in the
+ * page of FRAME instead, frees FRAME and returns true.  If PROMOTE,
+ * INTO comes from the unstable tree and becomes a stable frame. */
+static bool
+ksm_merge (struct frame *into, struct frame *frame, bool promote) {
+	struct page *page = frame->page;
+	enum intr_level old_level;
+	bool same;
+
+	/* With interrupts off no process can write either page between
+	 * the comparison and the remapping. */
+	old_level = intr_disable ();
+	same = memcmp (into->kva, frame->kva, PGSIZE) == 0;
+	if (same) {
+		if (promote) {
+			ksm_map_readonly (into->page, into->kva);
+			ksm_forget (into);
+			into->ksm = KSM_STABLE;
+			hash_insert (&stable_tree, &into->ksm_elem);
+		}
+		page->frame = into;
+		list_push_back (&into->sharers, &page->share_elem);
+		ksm_map_readonly (page, into->kva);
+		frame->page = NULL;
+	}
+	intr_set_level (old_level);
+
+	if (same) {
+		vm_frame_free (frame);
+		merge_cnt++;
+	}
+	return same;
+}
+
+/* Returns whether FRAME holds a page that may be merged. */
+static bool
+ksm_candidate (struct frame *frame) {
+	struct page *page = frame->page;
+
+	return frame->ksm == KSM_NONE
+		&& page_get_type (page) == VM_ANON
+		&& page->writable
+		&& list_empty (&frame->sharers);
+}
+
+/* Looks at FRAME once in this pass.  Returns false when the batch
+ * budget in *BUDGET_ is used up. */
+static bool
+ksm_scan_frame (struct frame *frame, void *budget_) {
+	size_t *budget = budget_;
+	struct frame *match;
+	uint64_t sum;
+
+	if (frame->ksm_pass == ksm_pass)
+		return true;
+	frame->ksm_pass = ksm_pass;
+
+	if (ksm_candidate (frame)) {
+		/* Changed since the last pass: too volatile to merge. */
+		sum = hash_bytes (frame->kva, PGSIZE);
+		if (sum != frame->ksm_sum)
+			frame->ksm_sum = sum;
+		else if ((match = ksm_lookup (&stable_tree, frame)) != NULL)
+			ksm_merge (match, frame, false);
+		else if ((match = ksm_lookup (&unstable_tree, frame)) != NULL)
+			ksm_merge (match, frame, true);
+		else if (hash_insert (&unstable_tree, &frame->ksm_elem) == NULL)
+			frame->ksm = KSM_UNSTABLE;
+	}
+	return --*budget > 0;
+}
+
+static void
+ksm_drop_unstable (struct hash_elem *e, void *aux UNUSED) {
+	hash_entry (e, struct frame, ksm_elem)->ksm = KSM_NONE;
+}
+
+static void
+ksm_thread (void *aux UNUSED) {
+	for (;;) {
+		size_t budget = KSM_PAGES_TO_SCAN;
+
+		lock_acquire (&frame_lock);
+		vm_frame_walk (ksm_scan_frame, &budget);
+		if (budget > 0) {
+			/* Every frame has been looked at: start a new pass. */
+			hash_clear (&unstable_tree, ksm_drop_unstable);
+			ksm_pass++;
+			full_scan_cnt++;
+		}
+		lock_release (&frame_lock);
+
+		timer_msleep (KSM_SLEEP_MS);
+	}
+}
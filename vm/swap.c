@@ -0,0 +1,324 @@
+/* swap.c: Swap areas.
+ *
+ * Anonymous pages are swapped to one or more areas: whole disks, or
+ * files on the file system disk.  A file area is read and written
+ * straight through the file's sectors, which are looked up once when
+ * it is set up, so swapping never goes through the file system.
+ *
+ * The slots of all areas are numbered in one space, each area owning
+ * a contiguous range, so the rest of the VM keeps using plain slot
+ * numbers.  A run of slots handed out by swap_slot_alloc() never
+ * crosses areas.  Areas with a higher priority fill first; among
+ * areas of the same priority, the one whose disk has moved the fewest
+ * sectors so far is tried first, to spread swap away from busy disks.
+ *
+ * A slot may hold the contents of several pages at once, after a
+ * fork, so each slot has a reference count; it is free again only
+ * when the last page lets go of it.
+ *
+ * Callers serialize with their own lock (swap_lock in anon.c). */
+
+#include "vm/swap.h"
+#include <bitmap.h>
+#include <debug.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "devices/disk.h"
+#include "filesys/file.h"
+#include "filesys/filesys.h"
+#include "filesys/inode.h"
+#include "threads/malloc.h"
+#include "threads/vaddr.h"
+#include "vm/vm.h"
+
+/* A place to swap to. */
+struct swap_area {
+	char name[16];                 /* "hd1:1" or the file's name. */
+	int prio;                      /* Higher fills first. */
+	struct disk *disk;             /* Disk holding the slots. */
+	struct file *file;             /* Swap file, kept open, or NULL. */
+	disk_sector_t *sectors;        /* First sector of each slot in FILE. */
+	size_t base;                   /* First slot, in the global numbering. */
+	size_t slot_cnt;               /* Slots in the area. */
+	struct bitmap *used;           /* Allocated, or unusable, slots. */
+	uint16_t *refs;                /* Pages holding each slot. */
+	size_t hint;                   /* Where the next run search starts. */
+
+	/* Statistics. */
+	size_t used_cnt;               /* Slots allocated now. */
+	size_t peak_cnt;               /* Most slots allocated at once. */
+	uint64_t in_cnt, out_cnt;      /* Pages read, written. */
+};
+
+char *swap_option;
+
+static struct swap_area areas[SWAP_AREA_MAX];
+static size_t area_cnt;
+static size_t slot_total;
+
+/* Adds an area of SLOT_CNT slots on DISK and returns it, or NULL if
+ * there are too many areas. */
+static struct swap_area *
+area_add (const char *name, int prio, struct disk *disk, size_t slot_cnt) {
+	struct swap_area *a;
+
+	if (area_cnt >= SWAP_AREA_MAX || slot_cnt == 0)
+		return NULL;
+	a = &areas[area_cnt];
+	memset (a, 0, sizeof *a);
+	strlcpy (a->name, name, sizeof a->name);
+	a->prio = prio;
+	a->disk = disk;
+	a->base = slot_total;
+	a->slot_cnt = slot_cnt;
+	a->used = bitmap_create (slot_cnt);
+	a->refs = calloc (slot_cnt, sizeof *a->refs);
+	if (a->used == NULL || a->refs == NULL) {
+		bitmap_destroy (a->used);
+		free (a->refs);
+		return NULL;
+	}
+	area_cnt++;
+	slot_total += slot_cnt;
+	return a;
+}
+
+/* Adds disk CHAN_NO:DEV_NO as a swap area. */
+static bool
+area_add_disk (const char *name, int chan_no, int dev_no, int prio) {
+	struct disk *disk = disk_get (chan_no, dev_no);
+
+	if (disk == NULL || disk == filesys_disk)
+		return false;
+	return area_add (name, prio, disk, disk_size (disk) / SLOT_SIZE) != NULL;
+}
+
+/* Adds file NAME, on the file system disk, as a swap area.  Slots
+ * whose sectors are not contiguous on disk are never used. */
+static bool
+area_add_file (const char *name, int prio) {
+	struct file *file = filesys_open (name);
+	struct swap_area *a;
+	size_t slot, i;
+
+	if (file == NULL)
+		return false;
+	a = area_add (name, prio, filesys_disk, file_length (file) / PGSIZE);
+	if (a == NULL || (a->sectors = malloc (a->slot_cnt * sizeof *a->sectors)) == NULL) {
+		file_close (file);
+		return false;
+	}
+
+	/* Nobody else may write the file while it holds swapped pages. */
+	file_deny_write (file);
+	a->file = file;
+	for (slot = 0; slot < a->slot_cnt; slot++) {
+		struct inode *inode = file_get_inode (file);
+		disk_sector_t first = inode_get_sector (inode, slot * PGSIZE);
+
+		a->sectors[slot] = first;
+		for (i = 1; i < SLOT_SIZE; i++)
+			if (inode_get_sector (inode, slot * PGSIZE + i * DISK_SECTOR_SIZE)
+					!= first + i) {
+				bitmap_mark (a->used, slot);
+				break;
+			}
+	}
+	return true;
+}
+
+/* Adds the area described by SPEC: "hdC:D" or a file name, optionally
+ * followed by "@PRIO". */
+static bool
+area_add_spec (char *spec) {
+	char *at = strchr (spec, '@');
+	int prio = 0;
+
+	if (at != NULL) {
+		*at = '\0';
+		prio = atoi (at + 1);
+	}
+	if (spec[0] == 'h' && spec[1] == 'd' && spec[2] >= '0' && spec[2] <= '9'
+			&& spec[3] == ':' && spec[4] >= '0' && spec[4] <= '9'
+			&& spec[5] == '\0')
+		return area_add_disk (spec, spec[2] - '0', spec[4] - '0', prio);
+	return area_add_file (spec, prio);
+}
+
+/* Sets up the swap areas named by swap_option. */
+void
+swap_init (void) {
+	char *spec, *save_ptr;
+
+	if (swap_option == NULL) {
+		area_add_disk ("hd1:1", 1, 1, 0);
+		return;
+	}
+	for (spec = strtok_r (swap_option, ",", &save_ptr); spec != NULL;
+			spec = strtok_r (NULL, ",", &save_ptr))
+		if (!area_add_spec (spec))
+			PANIC ("swap_init: cannot swap to `%s'", spec);
+}
+
+/* Returns the number of slots in all areas. */
+size_t
+swap_slot_cnt (void) {
+	return slot_total;
+}
+
+/* Returns the area that holds SLOT. */
+static struct swap_area *
+slot_area (size_t slot) {
+	size_t i;
+
+	for (i = 0; i < area_cnt; i++)
+		if (slot - areas[i].base < areas[i].slot_cnt)
+			return &areas[i];
+	PANIC ("slot_area: no swap slot %zu", slot);
+}
+
+/* Returns whether area A should be tried before area B. */
+static bool
+area_before (struct swap_area *a, struct swap_area *b) {
+	if (a->prio != b->prio)
+		return a->prio > b->prio;
+	return disk_io_cnt (a->disk) < disk_io_cnt (b->disk);
+}
+
+/* Allocates CNT contiguous slots in one area, each with one
+ * reference, and returns the first, or BITMAP_ERROR if no area has
+ * such a run. */
+size_t
+swap_slot_alloc (size_t cnt) {
+	struct swap_area *order[SWAP_AREA_MAX];
+	size_t i, j;
+
+	/* Insertion sort: there are only a few areas. */
+	for (i = 0; i < area_cnt; i++) {
+		for (j = i; j > 0 && area_before (&areas[i], order[j - 1]); j--)
+			order[j] = order[j - 1];
+		order[j] = &areas[i];
+	}
+
+	for (i = 0; i < area_cnt; i++) {
+		struct swap_area *a = order[i];
+		size_t slot = bitmap_scan_and_flip (a->used, a->hint, cnt, false);
+
+		if (slot == BITMAP_ERROR)
+			slot = bitmap_scan_and_flip (a->used, 0, cnt, false);
+		if (slot == BITMAP_ERROR)
+			continue;
+
+		/* Lay consecutive clusters out one after another. */
+		a->hint = slot + cnt;
+		for (j = slot; j < slot + cnt; j++)
+			a->refs[j] = 1;
+		a->used_cnt += cnt;
+		if (a->used_cnt > a->peak_cnt)
+			a->peak_cnt = a->used_cnt;
+		return a->base + slot;
+	}
+	return BITMAP_ERROR;
+}
+
+/* Adds a reference to SLOT, for one more page holding its contents. */
+void
+swap_slot_dup (size_t slot) {
+	struct swap_area *a = slot_area (slot);
+
+	ASSERT (a->refs[slot - a->base] > 0 && a->refs[slot - a->base] < UINT16_MAX);
+	a->refs[slot - a->base]++;
+}
+
+/* Drops a reference to SLOT.  Returns true if that was the last one,
+ * in which case SLOT is free. */
+bool
+swap_slot_free (size_t slot) {
+	struct swap_area *a = slot_area (slot);
+
+	ASSERT (a->refs[slot - a->base] > 0);
+	if (--a->refs[slot - a->base] > 0)
+		return false;
+	bitmap_reset (a->used, slot - a->base);
+	a->used_cnt--;
+	return true;
+}
+
+/* Returns the number of pages holding SLOT, 0 if it is free. */
+size_t
+swap_slot_refs (size_t slot) {
+	struct swap_area *a;
+
+	if (slot >= slot_total)
+		return 0;
+	a = slot_area (slot);
+	return a->refs[slot - a->base];
+}
+
+/* Returns the slot past the last one of the area that holds SLOT:
+ * runs of slots that move together must end before it. */
+size_t
+swap_slot_limit (size_t slot) {
+	struct swap_area *a = slot_area (slot);
+
+	return a->base + a->slot_cnt;
+}
+
+/* Moves the CNT slots from SLOT, which lie in one area, to or from
+ * BUF, with one disk command per run of slots adjacent on disk. */
+static void
+swap_io (size_t slot, size_t cnt, void *buf, bool write) {
+	struct swap_area *a = slot_area (slot);
+	size_t i = slot - a->base, end = i + cnt, run;
+
+	ASSERT (end <= a->slot_cnt);
+
+	if (write)
+		a->out_cnt += cnt;
+	else
+		a->in_cnt += cnt;
+
+	for (; i < end; i = run) {
+		disk_sector_t sector = a->sectors != NULL ? a->sectors[i] : i * SLOT_SIZE;
+
+		run = i + 1;
+		while (run < end && a->sectors != NULL
+				&& a->sectors[run] == sector + (run - i) * SLOT_SIZE)
+			run++;
+		if (a->sectors == NULL)
+			run = end;
+
+		if (write)
+			disk_write_multiple (a->disk, sector, (run - i) * SLOT_SIZE, buf);
+		else
+			disk_read_multiple (a->disk, sector, (run - i) * SLOT_SIZE, buf);
+		buf = (uint8_t *) buf + (run - i) * PGSIZE;
+	}
+}
+
+/* Reads the CNT slots from SLOT into BUF. */
+void
+swap_read_slots (size_t slot, size_t cnt, void *buf) {
+	swap_io (slot, cnt, buf, false);
+}
+
+/* Writes BUF to the CNT slots from SLOT. */
+void
+swap_write_slots (size_t slot, size_t cnt, const void *buf) {
+	swap_io (slot, cnt, (void *) buf, true);
+}
+
+void
+swap_print_stats (void) {
+	size_t i;
+
+	for (i = 0; i < area_cnt; i++) {
+		struct swap_area *a = &areas[i];
+
+		printf ("Swap: %s (priority %d): %zu of %zu slots in use, %zu at peak, "
+				"%"PRIu64" pages in, %"PRIu64" out\n", a->name, a->prio,
+				a->used_cnt, a->slot_cnt, a->peak_cnt, a->in_cnt, a->out_cnt);
+	}
+}
@@ -3,3 +3,8 @@ vm_SRC += vm/uninit.c     # Uninitialized page
 vm_SRC += vm/anon.c       # Anonymous page
 vm_SRC += vm/file.c       # File mapped page
 vm_SRC += vm/inspect.c    # Testing utility
+vm_SRC += vm/zswap.c      # Compressed swap pool
+vm_SRC += vm/ksm.c        # Same-page merging
+vm_SRC += vm/writeback.c  # Dirty file page writeback
+vm_SRC += vm/vma.c        # Address space regions
+vm_SRC += vm/swap.c       # Swap areas
@@ -3,13 +3,59 @@
 #include "threads/malloc.h"
 #include "vm/vm.h"
 #include "vm/inspect.h"
+#include "vm/zswap.h"
+#include "vm/ksm.h"
+#include "vm/writeback.h"
+#include "vm/swap.h"
 #include "threads/mmu.h"
 #include "include/vm/uninit.h"
+#include "intrinsic.h"
+#include <bitmap.h>
+#include <inttypes.h>
+#include <stdio.h>
 #include <string.h>
 
 #define ONE_MB (1 << 20)
 
-struct list frame_table;
+/* Frames that back a page, split by recency.  Each list keeps its
+ * youngest frame at the front and its oldest at the back.  The reclaim
+ * scan always works from the back and moves every frame it inspects to
+ * the front of one of the lists, so the lists themselves are the scan
+ * hand: a frame is not looked at again until all the others have been. */
+static struct list active_list;
+static struct list inactive_list;
+static size_t active_cnt;
+static size_t inactive_cnt;
+struct lock frame_lock;
+
+/* Number of active frames looked at each time the inactive list needs
+ * to be refilled. */
+#define SHRINK_ACTIVE_BATCH 32
+
+/* Frame of zeros, mapped read-only for reads of anonymous pages that
+ * were never written.  A real frame is claimed on the first write. */
+static void *zero_kva;
+
+bool vmstat_on_exit;
+
+/* Reclaim statistics. */
+static uint64_t reclaim_scan_cnt;   /* Frames inspected by vm_get_victim(). */
+static uint64_t reclaim_steal_cnt;  /* Frames taken away from their page. */
+static uint64_t fault_around_cnt;   /* Pages loaded ahead of their fault. */
+static uint64_t cow_break_cnt;      /* Private copies made on write. */
+static uint64_t lazy_free_cnt;      /* MADV_FREE pages dropped unwritten. */
+static uint64_t direct_reclaim_cnt; /* Frames reclaimed by faulting threads. */
+static uint64_t kswapd_reclaim_cnt; /* Frames reclaimed by kswapd. */
+
+/* Background reclaim.  kswapd is woken when a frame allocation leaves
+ * fewer than low_wmark free user pages, and evicts until there are
+ * high_wmark, so that faults rarely have to evict themselves.
+ * kswapd_busy is protected by frame_lock, under which kswapd also
+ * decides that it is done, so that no wakeup is lost. */
+static size_t low_wmark, high_wmark;
+static struct semaphore kswapd_wake;
+static bool kswapd_busy;
+static void kswapd (void *aux UNUSED);
 
 static unsigned page_hash (const struct hash_elem *p_, void *aux UNUSED);
 static bool page_less (const struct hash_elem *a_, const struct hash_elem *b_, void *aux UNUSED);
@@ -27,7 +73,41 @@ vm_init (void) {
 	register_inspect_intr ();
 	/* DO NOT MODIFY UPPER LINES. */
 	/* TODO: Your code goes here. */
-	list_init(&frame_table);
+	zero_kva = palloc_get_page (PAL_ASSERT | PAL_ZERO);
+	list_init (&active_list);
+	list_init (&inactive_list);
+	lock_init (&frame_lock);
+#ifndef EFILESYS
+	/* The page cache only needs frames, so mmap shares it here too. */
+	pagecache_init ();
+#endif
+	ksm_init ();
+
+	low_wmark = palloc_pool_cnt (PAL_USER) / 32;
+	if (low_wmark < SWAP_CLUSTER)
+		low_wmark = SWAP_CLUSTER;
+	high_wmark = low_wmark * 2;
+	sema_init (&kswapd_wake, 0);
+	thread_create ("kswapd", PRI_DEFAULT, kswapd, NULL);
+}
+
+/* Prints reclaim statistics. */
+void
+vm_print_stats (void) {
+	printf ("VM: %"PRIu64" frames scanned, %"PRIu64" frames reclaimed "
+			"(%"PRIu64" direct, %"PRIu64" by kswapd)\n",
+			reclaim_scan_cnt, reclaim_steal_cnt,
+			direct_reclaim_cnt, kswapd_reclaim_cnt);
+	printf ("VM: %"PRIu64" pages faulted around, %"PRIu64" copy-on-write breaks, "
+			"%"PRIu64" lazily freed pages dropped\n",
+			fault_around_cnt, cow_break_cnt, lazy_free_cnt);
+	file_print_stats ();
+	page_cache_print_stats ();
+	ksm_print_stats ();
+	writeback_print_stats ();
+	zswap_print_stats ();
+	swap_print_stats ();
+	anon_print_stats ();
 }
 
 /* Get the type of the page. This function is useful if you want to know the
@@ -46,8 +126,11 @@ page_get_type (struct page *page) {
 
 /* Helpers */
 static struct frame *vm_get_victim (void);
+static struct frame *vm_get_frame (void);
 static bool vm_do_claim_page (struct page *page);
 static struct frame *vm_evict_frame (void);
+static struct frame *frame_new (void *kva);
+static void *vm_frame_release (struct frame *frame);
 
 /* Create the pending page object with initializer. If you want to create a
  * page, do not create it directly and make it through this function or
@@ -87,10 +170,14 @@ vm_alloc_page_with_initializer (enum vm_type type, void *upage, bool writable,
 
 		new_page->writable = writable;
 		new_page->pml4 = thread_current()->pml4;
+		new_page->stats = &spt->stats;
+		new_page->vma = vma_find(&spt->vmas, upage);
 		if (!spt_insert_page(spt, new_page)) {
 			free(new_page);
 			return false;
 		}
+		if (new_page->vma != NULL)
+			list_push_back(&new_page->vma->pages, &new_page->vma_elem);
 		return true;
 	}
 err:
@@ -125,43 +212,418 @@ spt_insert_page (struct supplemental_page_table *spt UNUSED,
 
 void
 spt_remove_page (struct supplemental_page_table *spt, struct page *page) {
-	hash_delete(&thread_current()->spt.spt_table, &page->hash_elem);
+	hash_delete(&spt->spt_table, &page->hash_elem);
+	if (page->vma != NULL)
+		list_remove (&page->vma_elem);
+	lock_acquire (&frame_lock);
 	vm_dealloc_page (page);
+	lock_release (&frame_lock);
+}
+
+/* Moves FRAME to the front of LRU, taking it off its current list. */
+static void
+frame_lru_move (struct frame *frame, enum frame_lru lru) {
+	ASSERT (lock_held_by_current_thread (&frame_lock));
+
+	if (frame->lru == LRU_ACTIVE) {
+		list_remove (&frame->frame_elem);
+		active_cnt--;
+	} else if (frame->lru == LRU_INACTIVE) {
+		list_remove (&frame->frame_elem);
+		inactive_cnt--;
+	}
+
+	frame->lru = lru;
+	if (lru == LRU_ACTIVE) {
+		list_push_front (&active_list, &frame->frame_elem);
+		active_cnt++;
+	} else if (lru == LRU_INACTIVE) {
+		list_push_front (&inactive_list, &frame->frame_elem);
+		inactive_cnt++;
+	}
+}
+
+/* Returns whether PAGE was accessed since the last call, and clears
+ * the accessed bit. */
+static bool
+page_test_and_clear_accessed (struct page *page) {
+	/* No process maps a page cache page itself. */
+	if (page_get_type (page) == VM_PAGE_CACHE)
+		return page_cache_accessed (page);
+	if (!pml4_is_accessed (page->pml4, page->va))
+		return false;
+	pml4_set_accessed (page->pml4, page->va, false);
 	return true;
 }
 
+/* Returns whether any page mapping FRAME was accessed since the last
+ * call, and clears their accessed bits. */
+static bool
+frame_test_and_clear_accessed (struct frame *frame) {
+	bool accessed = page_test_and_clear_accessed (frame->page);
+	struct list_elem *e;
+
+	for (e = list_begin (&frame->sharers); e != list_end (&frame->sharers);
+			e = list_next (e))
+		if (page_test_and_clear_accessed (
+					list_entry (e, struct page, share_elem)))
+			accessed = true;
+	return accessed;
+}
+
+/* Puts FRAME, which is on a reclaim list, where vm_get_victim() looks
+ * first, forgetting that it was used. */
+static void
+frame_reclaim_soon (struct frame *frame) {
+	frame_lru_move (frame, LRU_NONE);
+	frame_test_and_clear_accessed (frame);
+	frame->referenced = false;
+	frame->lru = LRU_INACTIVE;
+	list_push_back (&inactive_list, &frame->frame_elem);
+	inactive_cnt++;
+}
+
+/* Returns whether PAGE is anonymous memory given up with MADV_FREE
+ * and not written since, which reclaim may simply throw away. */
+static bool
+page_lazy_freeable (struct page *page) {
+	return page_get_type (page) == VM_ANON && page->anon.lazy_free
+		&& list_empty (&page->frame->sharers)
+		&& !pml4_is_dirty (page->pml4, page->va);
+}
+
+/* Returns whether reclaiming FRAME requires writing it somewhere.
+ * Only clean file-backed and page cache pages and lazily freed
+ * anonymous pages can be dropped for free. */
+static bool
+frame_needs_writeback (struct frame *frame) {
+	struct page *page = frame->page;
+	struct list_elem *e;
+
+	if (page_lazy_freeable (page))
+		return false;
+	if (page_get_type (page) == VM_PAGE_CACHE) {
+		if (page->page_cache.dirty)
+			return true;
+	} else if (page_get_type (page) != VM_FILE
+			|| pml4_is_dirty (page->pml4, page->va))
+		return true;
+	for (e = list_begin (&frame->sharers); e != list_end (&frame->sharers);
+			e = list_next (e)) {
+		page = list_entry (e, struct page, share_elem);
+		if (pml4_is_dirty (page->pml4, page->va))
+			return true;
+	}
+	return false;
+}
+
+/* Calls FUNC with AUX on every frame on the reclaim lists, until it
+ * returns false.  FUNC may free the frame it is given. */
+void
+vm_frame_walk (bool (*func) (struct frame *, void *), void *aux) {
+	struct list *lists[] = { &inactive_list, &active_list };
+	size_t i;
+
+	ASSERT (lock_held_by_current_thread (&frame_lock));
+
+	for (i = 0; i < sizeof lists / sizeof *lists; i++) {
+		struct list_elem *e = list_begin (lists[i]);
+
+		while (e != list_end (lists[i])) {
+			struct frame *frame = list_entry (e, struct frame, frame_elem);
+
+			e = list_next (e);
+			if (!func (frame, aux))
+				return;
+		}
+	}
+}
+
+/* Maps FRAME into PAGE as well, next to the pages that already map it. */
+void
+vm_frame_share (struct frame *frame, struct page *page) {
+	ASSERT (lock_held_by_current_thread (&frame_lock));
+	ASSERT (frame->page != NULL);
+
+	page->frame = frame;
+	list_push_back (&frame->sharers, &page->share_elem);
+	pml4_set_page (page->pml4, page->va, frame->kva, page->writable);
+}
+
+/* Unmaps PAGE from its frame if other pages still map the frame,
+ * handing the frame over to one of them, and returns true.  Returns
+ * false, changing nothing, if PAGE is the frame's only user. */
+bool
+vm_frame_unshare (struct page *page) {
+	struct frame *frame = page->frame;
+
+	ASSERT (lock_held_by_current_thread (&frame_lock));
+
+	if (frame->page == page) {
+		if (list_empty (&frame->sharers))
+			return false;
+		frame->page = list_entry (list_pop_front (&frame->sharers),
+				struct page, share_elem);
+	} else
+		list_remove (&page->share_elem);
+
+	pml4_clear_page (page->pml4, page->va);
+	page->frame = NULL;
+	return true;
+}
+
+/* Swaps out every page that maps FRAME, a file or page cache frame,
+ * so that FRAME can be reused.  Anonymous frames go through
+ * anon_swap_out_cluster() instead. */
+static bool
+frame_swap_out (struct frame *frame) {
+	file_text_forget (frame);
+	anon_swap_forget (frame);
+	while (!list_empty (&frame->sharers))
+		if (!swap_out (list_entry (list_front (&frame->sharers),
+						struct page, share_elem)))
+			return false;
+	return swap_out (frame->page);
+}
+
+/* Ages up to CNT frames from the back of the active list.  Frames that
+ * were used since they were last looked at stay active, the others are
+ * moved to the inactive list. */
+static void
+shrink_active_list (size_t cnt) {
+	while (cnt-- > 0 && !list_empty (&active_list)) {
+		struct frame *frame =
+			list_entry (list_back (&active_list), struct frame, frame_elem);
+
+		reclaim_scan_cnt++;
+		if (frame_test_and_clear_accessed (frame))
+			frame_lru_move (frame, LRU_ACTIVE);
+		else {
+			frame->referenced = false;
+			frame_lru_move (frame, LRU_INACTIVE);
+		}
+	}
+}
+
 /* Get the struct frame, that will be evicted. */
 static struct frame *
 vm_get_victim (void) {
 	struct frame *victim = NULL;
-	 /* TODO: The policy for eviction is up to you. */
-	struct thread *curr = thread_current();
-	
-	struct list_elem *e = list_begin(&frame_table);
-	for (e; e != list_end(&frame_table); e = list_next(e)) {
-		victim = list_entry(e, struct frame, frame_elem);
-		if (pml4_is_accessed(victim->page->pml4, victim->page->va))
-			pml4_set_accessed(victim->page->pml4, victim->page->va, false);
-        else
-            return victim;
+	size_t dirty_skips = 0;
+
+	ASSERT (lock_held_by_current_thread (&frame_lock));
+	ASSERT (active_cnt + inactive_cnt > 0);
+
+	for (;;) {
+		/* Keep the inactive list at least as long as the active one. */
+		if (inactive_cnt <= active_cnt)
+			shrink_active_list (SHRINK_ACTIVE_BATCH);
+		if (list_empty (&inactive_list))
+			continue;
+
+		/* Every candidate needs a write: settle for the oldest. */
+		if (victim != NULL && dirty_skips >= inactive_cnt)
+			break;
+
+		struct frame *frame =
+			list_entry (list_back (&inactive_list), struct frame, frame_elem);
+
+		reclaim_scan_cnt++;
+		if (frame_test_and_clear_accessed (frame)) {
+			/* Promote on the second reference, so that pages touched
+			 * only once do not push the working set out. */
+			if (frame->referenced) {
+				frame->referenced = false;
+				frame_lru_move (frame, LRU_ACTIVE);
+			} else {
+				frame->referenced = true;
+				frame_lru_move (frame, LRU_INACTIVE);
+			}
+			continue;
+		}
+
+		if (!frame_needs_writeback (frame)) {
+			victim = frame;
+			break;
+		}
+
+		/* Look for a clean page before paying for a write. */
+		if (victim == NULL)
+			victim = frame;
+		dirty_skips++;
+		frame_lru_move (frame, LRU_INACTIVE);
 	}
 
-	return list_entry(list_begin(&frame_table), struct frame, frame_elem);
+	frame_lru_move (victim, LRU_NONE);
+	return victim;
+}
+
+/* Takes more anonymous frames that were not used lately off the back
+ * of the inactive list, to be swapped out together with FRAMES[0].
+ * Fills FRAMES and returns how many entries it holds. */
+static size_t
+gather_anon_cluster (struct frame **frames) {
+	struct list_elem *e = list_rbegin (&inactive_list);
+	size_t cnt = 1, scanned = 0;
+
+	while (cnt < SWAP_CLUSTER && scanned++ < 2 * SWAP_CLUSTER
+			&& e != list_rend (&inactive_list)) {
+		struct frame *frame = list_entry (e, struct frame, frame_elem);
+		struct page *page = frame->page;
+
+		e = list_prev (e);
+		reclaim_scan_cnt++;
+		if (page_get_type (page) != VM_ANON || page->anon.lazy_free
+				|| frame->ksm != KSM_NONE || !list_empty (&frame->sharers)
+				|| pml4_is_accessed (page->pml4, page->va))
+			continue;
+
+		frame_lru_move (frame, LRU_NONE);
+		frames[cnt++] = frame;
+	}
+	return cnt;
 }
 
 /* Evict one page and return the corresponding frame.
+ * Anonymous victims are swapped out in clusters: the other frames of
+ * the cluster go back to the page allocator, so that the next few
+ * faults find a free page without evicting.  The swap write happens
+ * without frame_lock, once the frames are off the reclaim lists and
+ * detached from their pages.  A dirty page cache victim
+ * is written back first, without frame_lock, and the search starts
+ * over, since it may not be the best victim by the time it is clean.
  * Return NULL on error.*/
 static struct frame *
 vm_evict_frame (void) {
-	struct frame *victim UNUSED = vm_get_victim ();
-	/* TODO: swap out the victim and return the evicted frame. */
-	if (victim->page)
-        swap_out(victim->page);
-	memset(victim->kva,0,PGSIZE);
+	struct frame *frames[SWAP_CLUSTER];
+	struct frame *victim;
+	size_t cnt, done, i;
+
+	for (;;) {
+		victim = vm_get_victim ();
+		if (page_get_type (victim->page) == VM_PAGE_CACHE
+				&& frame_needs_writeback (victim)) {
+			if (!page_cache_sync (victim->page))
+				frame_lru_move (victim, LRU_INACTIVE);
+			else if (active_cnt + inactive_cnt == 0)
+				return NULL;
+			continue;
+		}
+
+		cnt = 1;
+		frames[0] = victim;
+		ksm_forget (victim);
+		anon_swap_forget (victim);
+		if (page_lazy_freeable (victim->page)) {
+			anon_drop (victim->page);
+			lazy_free_cnt++;
+			reclaim_steal_cnt++;
+			victim->cow = false;
+			return victim;
+		}
+		if (page_get_type (victim->page) == VM_ANON) {
+			cnt = gather_anon_cluster (frames);
+			done = anon_swap_out_cluster (frames, cnt);
+		} else
+			done = frame_swap_out (victim) ? 1 : 0;
+		if (done > 0)
+			break;
+
+		/* Out of swap, or a page cache page that was dirtied again
+		 * through a mapping while the mappings were swapped out. */
+		frame_lru_move (victim, LRU_INACTIVE);
+		if (page_get_type (victim->page) != VM_PAGE_CACHE)
+			return NULL;
+	}
+
+	for (i = 1; i < done; i++)
+		vm_frame_free (frames[i]);
+	reclaim_steal_cnt += done;
+	victim->cow = false;
 
     return victim;
 }
 
+/* Reclaims frames in the background while free user pages are short. */
+static void
+kswapd (void *aux UNUSED) {
+	for (;;) {
+		sema_down (&kswapd_wake);
+
+		lock_acquire (&frame_lock);
+		while (palloc_free_cnt (PAL_USER) < high_wmark
+				&& active_cnt + inactive_cnt > 0) {
+			uint64_t steal_cnt = reclaim_steal_cnt;
+			struct frame *victim = vm_evict_frame ();
+
+			if (victim != NULL)
+				vm_frame_free (victim);
+			kswapd_reclaim_cnt += reclaim_steal_cnt - steal_cnt;
+
+			/* Out of swap: leave the rest to direct reclaim. */
+			if (victim == NULL)
+				break;
+
+			/* Let faults in between evictions. */
+			lock_release (&frame_lock);
+			lock_acquire (&frame_lock);
+		}
+		kswapd_busy = false;
+		lock_release (&frame_lock);
+	}
+}
+
+/* Returns a new frame, on no reclaim list, for a page that no process
+ * maps, such as a page cache page.  Evicts if it has to. */
+struct frame *
+vm_frame_alloc (void) {
+	return vm_get_frame ();
+}
+
+/* Moves FRAME to the front of reclaim list LRU, or takes it off the
+ * lists with LRU_NONE so that it cannot be reclaimed, for frames kept
+ * outside this file. */
+void
+vm_frame_set_lru (struct frame *frame, enum frame_lru lru) {
+	frame_lru_move (frame, lru);
+}
+
+/* Releases FRAME, which must no longer be linked to a page. */
+void
+vm_frame_free (struct frame *frame) {
+	palloc_free_page (vm_frame_release (frame));
+}
+
+/* Like vm_frame_free(), but keeps the frame's page and returns it,
+ * for the caller to free with palloc_free_page(). */
+static void *
+vm_frame_release (struct frame *frame) {
+	void *kva = frame->kva;
+
+	ASSERT (lock_held_by_current_thread (&frame_lock));
+	ASSERT (list_empty (&frame->sharers));
+
+	file_text_forget (frame);
+	ksm_forget (frame);
+	anon_swap_forget (frame);
+	frame_lru_move (frame, LRU_NONE);
+	free (frame);
+	return kva;
+}
+
+/* Wraps the user pool page KVA in a new frame that is on no list. */
+static struct frame *
+frame_new (void *kva) {
+	struct frame *frame = calloc (1, sizeof *frame);
+
+	if (frame == NULL)
+		PANIC ("frame_new: out of kernel memory");
+	frame->kva = kva;
+	frame->lru = LRU_NONE;
+	list_init (&frame->sharers);
+	return frame;
+}
+
 /* palloc() and get frame. If there is no available page, evict the page
  * and return it. This always return valid address. That is, if the user pool
  * memory is full, this function evicts the frame to get the available memory
@@ -169,24 +631,51 @@ vm_evict_frame (void) {
 /* palloc()과 프레임을 가져온다. 항상 유효한 주소를 반환한다. 
  * 사용자 풀 메모리가 가득 찬 경우 사용 가능한 메모리 공간을 얻기 위해 프레임을 제거한다.
  * palloc_get_page 함수를 호출하여 메모리 풀에서 새로운 물리메모리 페이지를 가져온다. 
- * 성공적으로 가져오면 프레임을 할당하고 프레임 구조체의 멤버들을 초기화한 후 해당 프레임을 반환한다.*/
+ * 성공적으로 가져오면 프레임을 할당하고 프레임 구조체의 멤버들을 초기화한 후 해당 프레임을 반환한다.
+ * 반환된 프레임은 어느 리스트에도 속하지 않으며, 페이지를 읽어 들인 뒤에 리스트에 넣는다. */
 static struct frame *
 vm_get_frame (void) {
-	struct frame *frame = calloc(1, sizeof(struct frame));
+	struct frame *frame;
 	void *kva = palloc_get_page(PAL_USER | PAL_ZERO);
+
+	if (palloc_free_cnt(PAL_USER) < low_wmark) {
+		lock_acquire (&frame_lock);
+		if (!kswapd_busy) {
+			kswapd_busy = true;
+			sema_up(&kswapd_wake);
+		}
+		lock_release (&frame_lock);
+	}
+
 	if (kva == NULL) {
-		// PANIC("TODO: swap out");
-		free(frame);
-		frame = vm_evict_frame();
+		uint64_t steal_cnt;
 
-		// frame->page = NULL;
-		// return frame;
-	} else {
-		frame->kva = kva;
-		list_push_back(&frame_table, &frame->frame_elem);
+		// kswapd가 따라오지 못했으면 직접 쫓아낸다.
+		lock_acquire (&frame_lock);
+		kva = palloc_get_page(PAL_USER | PAL_ZERO);
+		if (kva == NULL) {
+			steal_cnt = reclaim_steal_cnt;
+			frame = vm_evict_frame();
+			if (frame != NULL) {
+				direct_reclaim_cnt += reclaim_steal_cnt - steal_cnt;
+				memset(frame->kva, 0, PGSIZE);
+			} else {
+				/* Everything may have been freed while eviction
+				 * released frame_lock to write. */
+				kva = palloc_get_page(PAL_USER | PAL_ZERO);
+				if (kva == NULL)
+					PANIC ("vm_get_frame: out of swap space");
+			}
+		}
+		lock_release (&frame_lock);
 	}
+	if (kva != NULL)
+		frame = frame_new(kva);
 
 	frame->page = NULL;
+	frame->lru = LRU_NONE;
+	frame->referenced = false;
+	frame->ksm_sum = 0;
 
 	ASSERT (frame != NULL);
 	ASSERT (frame->page == NULL);
@@ -195,60 +684,527 @@ vm_get_frame (void) {
 }
 
 /* Growing the stack. */
-static void
+/* 스택 영역을 ADDR까지 늘린다. 페이지는 처음 닿을 때 만들어진다. */
+static bool
 vm_stack_growth (void *addr UNUSED) {
-	void *stack_bottom = thread_current()->stack_bottom;
+	struct thread *curr = thread_current();
+	struct vma *stack = vma_find(&curr->spt.vmas, curr->stack_bottom);
+	void *stack_bottom = pg_round_down(addr);
 
-    while (stack_bottom > addr) {
-        stack_bottom = (void *)(((uint8_t *)stack_bottom) - PGSIZE);
+	curr->spt.stats.stack_faults++;
+	if (stack == NULL
+			|| !vma_extend_down(&curr->spt.vmas, stack, stack_bottom))
+		return false;
+	curr->stack_bottom = stack_bottom;
+	return true;
+}
 
-        if (!vm_alloc_page(VM_ANON | VM_MARKER_0, stack_bottom, 1))
-            return;
+/* Returns whether PAGE reads as zeros until it is first written: an
+ * anonymous page with nothing to load that has not been claimed yet. */
+static bool
+page_is_zero_fill (struct page *page) {
+	return VM_TYPE (page->operations->type) == VM_UNINIT
+		&& VM_TYPE (page->uninit.type) == VM_ANON
+		&& page->uninit.init == NULL;
+}
 
-        if (!vm_claim_page(stack_bottom))
-            return;
-    }
-    thread_current()->stack_bottom = stack_bottom;
+/* Gives PAGE, which maps a merged frame read-only, a private writable
+ * frame again.  The last page left on a merged frame takes it over. */
+static bool
+vm_break_cow (struct page *page) {
+	struct frame *old = page->frame, *frame = NULL;
+
+	lock_acquire (&frame_lock);
+	while (page->frame == old && !list_empty (&old->sharers)
+			&& frame == NULL) {
+		lock_release (&frame_lock);
+		frame = vm_get_frame ();
+		lock_acquire (&frame_lock);
+	}
+
+	if (page->frame != old) {
+		/* Evicted meanwhile: the retried access swaps it in. */
+	} else if (vm_frame_unshare (page)) {
+		memcpy (frame->kva, old->kva, PGSIZE);
+		frame->page = page;
+		page->frame = frame;
+		pml4_set_page (page->pml4, page->va, frame->kva, true);
+		frame_lru_move (frame, LRU_ACTIVE);
+		frame = NULL;
+		cow_break_cnt++;
+		page->stats->cow_breaks++;
+	} else {
+		ksm_forget (old);
+		anon_swap_forget (old);
+		old->cow = false;
+		pml4_clear_page (page->pml4, page->va);
+		pml4_set_page (page->pml4, page->va, old->kva, true);
+	}
+
+	if (frame != NULL)
+		vm_frame_free (frame);
+	lock_release (&frame_lock);
+	return true;
 }
 
 /* Handle the fault on write_protected page */
+/* zero page에 처음 쓰는 순간에야 실제 프레임을 할당한다. */
 static bool
-vm_handle_wp (struct page *page UNUSED) {
+vm_handle_wp (struct page *page) {
+	if (!page->writable)
+		return false;
+
+	if (pml4_get_page (page->pml4, page->va) == zero_kva) {
+		pml4_clear_page (page->pml4, page->va);
+		return vm_do_claim_page (page);
+	}
+
+	if (page->frame != NULL
+			&& (page->frame->ksm == KSM_STABLE || page->frame->cow))
+		return vm_break_cow (page);
+	return false;
 }
 
-/* Return true on success */
-bool
-vm_try_handle_fault (struct intr_frame *f UNUSED, void *addr UNUSED,
+/* Returns the load information of PAGE if it is a page whose contents
+ * still have to be read from a file, or NULL. */
+static struct load_segment_aux *
+page_file_aux (struct page *page) {
+	if (VM_TYPE (page->operations->type) != VM_UNINIT
+			|| page->uninit.init != lazy_load_segment)
+		return NULL;
+	return page->uninit.aux;
+}
+
+/* Creates the page at VA, which VMA holds, and returns it.  If part of
+ * it comes from the file, that part is described in *AUX, which the
+ * caller keeps in scope until the page is loaded or removed.  Returns
+ * NULL if VA lies past the end of the file of a file mapping, or if
+ * memory runs out. */
+static struct page *
+vma_create_page (struct vma *vma, void *va, struct load_segment_aux *aux) {
+	size_t ofs = va - vma->start;
+	bool ok;
+
+	ASSERT (pg_ofs (va) == 0);
+
+	if (ofs < vma->read_bytes) {
+		aux->file = vma->file;
+		aux->ofs = vma->ofs + ofs;
+		aux->read_bytes = vma->read_bytes - ofs < PGSIZE
+			? vma->read_bytes - ofs : PGSIZE;
+		aux->zero_bytes = PGSIZE - aux->read_bytes;
+		ok = vm_alloc_page_with_initializer (vma->type, va, vma->writable,
+				lazy_load_segment, aux);
+	} else if (VM_TYPE (vma->type) == VM_FILE && !(vma->type & VM_TEXT))
+		return NULL;
+	else
+		/* Nothing to read (.bss, stack): a zero-fill page. */
+		ok = vm_alloc_page (VM_ANON, va, vma->writable);
+
+	return ok ? spt_find_page (&thread_current ()->spt, va) : NULL;
+}
+
+/* Finds the fault-around stream of SPT that a fault at offset OFS in
+ * FILE belongs to, and adapts its window: doubled when the fault
+ * continues the stream, halved when it lands elsewhere in the file. */
+static struct fault_around *
+fault_around_lookup (struct supplemental_page_table *spt, struct file *file,
+		off_t ofs) {
+	struct fault_around *fa, *same_file = NULL;
+	size_t i;
+
+	for (i = 0; i < FAULT_AROUND_SLOTS; i++) {
+		fa = &spt->fault_around[i];
+		if (fa->file != file)
+			continue;
+		if (fa->next_ofs == ofs) {
+			fa->window = fa->window * 2 < FAULT_AROUND_MAX
+				? fa->window * 2 : FAULT_AROUND_MAX;
+			return fa;
+		}
+		if (same_file == NULL)
+			same_file = fa;
+	}
+
+	if (same_file != NULL) {
+		same_file->window = same_file->window > 1 ? same_file->window / 2 : 1;
+		return same_file;
+	}
+
+	fa = &spt->fault_around[spt->fault_around_next++ % FAULT_AROUND_SLOTS];
+	fa->file = file;
+	fa->window = FAULT_AROUND_INIT;
+	return fa;
+}
+
+/* PAGE and the CNT - 1 pages after it were just loaded by a sequential
+ * scan: the pages a full fault-around window behind are unlikely to be
+ * used again, so they are reclaimed first. */
+static void
+vm_drop_behind (struct page *page, size_t cnt) {
+	struct supplemental_page_table *spt = &thread_current ()->spt;
+	size_t i;
+
+	if (page->vma == NULL || !page->vma->sequential
+			|| (uintptr_t) page->va < (FAULT_AROUND_MAX + cnt) * PGSIZE)
+		return;
+
+	lock_acquire (&frame_lock);
+	for (i = 1; i <= cnt; i++) {
+		struct page *old = spt_find_page (spt,
+				page->va - (FAULT_AROUND_MAX + i) * PGSIZE);
+
+		if (old != NULL && old->vma == page->vma && old->frame != NULL
+				&& old->frame->lru != LRU_NONE)
+			frame_reclaim_soon (old->frame);
+	}
+	lock_release (&frame_lock);
+}
+
+/* Claims PAGE, whose contents come from a file, together with the
+ * untouched pages that follow it in its region, up to the stream's
+ * window, with a single file read.  Only PAGE may evict to get a
+ * frame; the others are loaded only while free frames last. */
+static bool
+vm_fault_around (struct page *page) {
+	struct supplemental_page_table *spt = &thread_current ()->spt;
+	struct load_segment_aux *aux = page_file_aux (page);
+	struct load_segment_aux auxes[FAULT_AROUND_MAX];
+	struct page *pages[FAULT_AROUND_MAX];
+	struct frame *frames[FAULT_AROUND_MAX];
+	struct vma *vma = page->vma;
+	struct fault_around *fa;
+	size_t cnt = 1, bytes = aux->read_bytes, i;
+	uint8_t *buf;
+
+	fa = fault_around_lookup (spt, aux->file, aux->ofs);
+	if (vma != NULL && vma->sequential)
+		fa->window = FAULT_AROUND_MAX;
+
+	/* Count the untouched pages that continue the file run. */
+	while (vma != NULL && cnt < fa->window && bytes == cnt * PGSIZE) {
+		void *va = page->va + cnt * PGSIZE;
+		size_t ofs = va - vma->start, len;
+
+		if (va >= vma->end || ofs >= vma->read_bytes
+				|| spt_find_page (spt, va) != NULL)
+			break;
+		len = vma->read_bytes - ofs < PGSIZE ? vma->read_bytes - ofs : PGSIZE;
+		if ((vma->type & VM_TEXT)
+				&& file_text_cached (vma->file, vma->ofs + ofs, len))
+			break;
+		bytes += len;
+		cnt++;
+	}
+
+	buf = cnt > 1 ? palloc_get_multiple (0, cnt) : NULL;
+	if (buf == NULL) {
+		fa->next_ofs = aux->ofs + aux->read_bytes;
+		return vm_do_claim_page (page);
+	}
+
+	pages[0] = page;
+	frames[0] = vm_get_frame ();
+	for (i = 1; i < cnt; i++) {
+		void *kva = palloc_get_page (PAL_USER);
+		if (kva == NULL)
+			break;
+		pages[i] = vma_create_page (vma, page->va + i * PGSIZE, &auxes[i]);
+		if (pages[i] == NULL) {
+			palloc_free_page (kva);
+			break;
+		}
+		frames[i] = frame_new (kva);
+	}
+	if (i < cnt) {
+		/* Every page before the last one counted is a whole page. */
+		cnt = i;
+		bytes = cnt * PGSIZE < bytes ? cnt * PGSIZE : bytes;
+	}
+
+	spt->stats.fault_io = true;
+	if (file_read_at (aux->file, buf, bytes, aux->ofs) != (off_t) bytes) {
+		lock_acquire (&frame_lock);
+		for (i = 0; i < cnt; i++)
+			vm_frame_free (frames[i]);
+		lock_release (&frame_lock);
+		for (i = 1; i < cnt; i++)
+			spt_remove_page (spt, pages[i]);
+		palloc_free_multiple (buf, cnt);
+		return false;
+	}
+
+	for (i = 0; i < cnt; i++) {
+		struct page *p = pages[i];
+		struct frame *frame = frames[i];
+		size_t len = bytes - i * PGSIZE < PGSIZE ? bytes - i * PGSIZE : PGSIZE;
+
+		memcpy (frame->kva, buf + i * PGSIZE, len);
+		memset (frame->kva + len, 0, PGSIZE - len);
+
+		/* The contents are in place, so only the type-specific setup
+		 * of uninit_initialize() is left to do. */
+		frame->page = p;
+		p->frame = frame;
+		p->uninit.page_initializer (p, p->uninit.type, frame->kva);
+		pml4_set_page (p->pml4, p->va, frame->kva, p->writable);
+
+		lock_acquire (&frame_lock);
+		frame_lru_move (frame, LRU_INACTIVE);
+		file_text_publish (p);
+		lock_release (&frame_lock);
+	}
+	palloc_free_multiple (buf, cnt);
+
+	fa->next_ofs = aux->ofs + bytes;
+	fault_around_cnt += cnt - 1;
+	vm_drop_behind (page, cnt);
+	return true;
+}
+
+/* Loads the contents of PAGE, which has no frame, the cheapest way. */
+static bool
+vm_load_page (struct page *page) {
+	if (file_text_map (page)) // 다른 프로세스가 읽어 둔 text 프레임을 공유
+		return true;
+
+	if (anon_swap_map (page)) // 같은 스왑 슬롯을 먼저 읽어 둔 프레임을 공유
+		return true;
+
+	if (file_cache_mapped (page)) // 파일 매핑은 페이지 캐시의 프레임을 그대로 매핑
+		return file_cache_map (page);
+
+	if (page_file_aux (page) != NULL) // 파일에서 읽는 페이지면 이웃 페이지도 함께
+		return vm_fault_around (page);
+
+	if (!vm_do_claim_page (page)) // page찾으면 레이지로딩
+		return false;
+	vm_drop_behind (page, 1);
+	return true;
+}
+
+/* Resolves the fault at ADDR.  Returns true on success. */
+static bool
+vm_handle_fault (struct intr_frame *f UNUSED, void *addr UNUSED,
 		bool user UNUSED, bool write UNUSED, bool not_present UNUSED) {
 	struct supplemental_page_table *spt UNUSED = &thread_current()->spt;
     struct page *page = NULL;
     /* TODO: Validate the fault */
 
     if (not_present) { // frame없어
+        struct load_segment_aux aux;
+        struct vma *vma;
+        bool created = false;
 
-        if (thread_current()->stack_bottom > addr && addr > USER_STACK - (1 << 20)) { // Are you stack? page 없어?
-            void *user_rsp = thread_current()->user_rsp;
-            if (user)
-                user_rsp = f->rsp;
-            if (user_rsp == addr || user_rsp - 8 == addr) {
-                vm_stack_growth(addr);
-                return true;
+        page = spt_find_page(spt, addr);
+        if (!page) { // page 없어: 영역 안이면 지금 만든다
+            vma = vma_find(&spt->vmas, addr);
+            if (!vma && thread_current()->stack_bottom > addr && addr > USER_STACK - (1 << 20)) { // Are you stack?
+                void *user_rsp = thread_current()->user_rsp;
+                if (user)
+                    user_rsp = f->rsp;
+                if (user_rsp != addr && user_rsp - 8 != addr)
+                    return false;
+                if (!vm_stack_growth(addr))
+                    return false;
+                vma = vma_find(&spt->vmas, addr);
             }
-            return false;
+            if (!vma) // 어느 영역에도 없어
+                return false; // ㄹㅇ 폴트
+            page = vma_create_page(vma, pg_round_down(addr), &aux);
+            if (!page)
+                return false;
+            created = true;
         }
 
-        page = spt_find_page(spt, addr);
-        if (!page) {      // page 없어, frame 없어
-            return false; // ㄹㅇ 폴트
-        }
+        if (!write && page_is_zero_fill(page)) // 읽기만 하면 프레임 없이 zero page
+            return pml4_set_page(page->pml4, page->va, zero_kva, false);
 
-        return vm_do_claim_page(page); // page찾으면 레이지로딩
+        if (vm_load_page(page))
+            return true;
+        if (created) // aux가 사라지기 전에 치운다
+            spt_remove_page(spt, page);
+        return false;
     }
 
     /* TODO: Your code goes here */
+    page = spt_find_page(spt, addr);
+    if (page != NULL && write)
+        return vm_handle_wp(page);
     return false;
 }
 
+/* Return true on success */
+bool
+vm_try_handle_fault (struct intr_frame *f, void *addr,
+		bool user, bool write, bool not_present) {
+	struct vm_stats *stats = &thread_current ()->spt.stats;
+	uint64_t start = rdtsc ();
+	bool success;
+
+	/* Whoever reads from disk on the way sets fault_io. */
+	stats->fault_io = false;
+	success = vm_handle_fault (f, addr, user, write, not_present);
+	if (success) {
+		if (stats->fault_io)
+			stats->major_faults++;
+		else
+			stats->minor_faults++;
+	}
+	stats->fault_cycles += rdtsc () - start;
+	return success;
+}
+
+/* Marks PAGE, an anonymous page, for MADV_FREE: reclaim may throw its
+ * contents away until it is written again. */
+static void
+page_lazy_free (struct page *page) {
+	struct frame *frame = page->frame;
+
+	ASSERT (lock_held_by_current_thread (&frame_lock));
+
+	if (VM_TYPE (page->operations->type) != VM_ANON)
+		return;
+	if (frame == NULL) {
+		/* Swapped out: the slot can go right away. */
+		anon_drop (page);
+	} else if (frame->page == page && list_empty (&frame->sharers)
+			&& frame->ksm == KSM_NONE && frame->lru != LRU_NONE) {
+		pml4_set_dirty (page->pml4, page->va, false);
+		page->anon.lazy_free = true;
+		frame_reclaim_soon (frame);
+	}
+}
+
+/* Removes the pages of VMA in [START, END) from the current process. */
+static void
+vma_remove_pages (struct vma *vma, void *start, void *end) {
+	struct supplemental_page_table *spt = &thread_current ()->spt;
+	struct list_elem *e, *next;
+
+	for (e = list_begin (&vma->pages); e != list_end (&vma->pages); e = next) {
+		struct page *page = list_entry (e, struct page, vma_elem);
+
+		next = list_next (e);
+		if (page->va >= start && page->va < end)
+			spt_remove_page (spt, page);
+	}
+}
+
+/* Applies ADVICE to the pages of VMA in [START, END). */
+static void
+vma_advise (struct vma *vma, void *start, void *end, enum vm_advice advice) {
+	struct supplemental_page_table *spt = &thread_current ()->spt;
+	struct list_elem *e;
+	void *va;
+
+	switch (advice) {
+		case VM_ADVICE_NORMAL:
+		case VM_ADVICE_SEQUENTIAL:
+			/* Regions are not split: the advice covers all of VMA. */
+			vma->sequential = advice == VM_ADVICE_SEQUENTIAL;
+			break;
+		case VM_ADVICE_WILLNEED:
+			for (va = start; va < end; va += PGSIZE) {
+				struct load_segment_aux aux;
+				struct page *page = spt_find_page (spt, va);
+				bool created = false;
+
+				/* Only a hint: never evict to follow it. */
+				if (palloc_free_cnt (PAL_USER) <= low_wmark)
+					return;
+				if (page == NULL) {
+					page = vma_create_page (vma, va, &aux);
+					created = true;
+				}
+				if (page == NULL || page->frame != NULL
+						|| page_is_zero_fill (page)
+						|| (VM_TYPE (page->operations->type) == VM_ANON
+							&& page->anon.slot == BITMAP_ERROR))
+					continue;
+				if (!vm_load_page (page) && created)
+					spt_remove_page (spt, page);
+			}
+			break;
+		case VM_ADVICE_DONTNEED:
+			/* Untouched again: the next access starts over from the
+			 * region, reading the file or zeros. */
+			vma_remove_pages (vma, start, end);
+			break;
+		case VM_ADVICE_FREE:
+			lock_acquire (&frame_lock);
+			for (e = list_begin (&vma->pages); e != list_end (&vma->pages);
+					e = list_next (e)) {
+				struct page *page = list_entry (e, struct page, vma_elem);
+
+				if (page->va >= start && page->va < end)
+					page_lazy_free (page);
+			}
+			lock_release (&frame_lock);
+			break;
+	}
+}
+
+/* Applies ADVICE to [ADDR, ADDR + LENGTH), one region at a time.
+ * Returns false, changing nothing, if part of the range is not
+ * mapped. */
+bool
+vm_madvise (void *addr, size_t length, enum vm_advice advice) {
+	struct vma_tree *vmas = &thread_current ()->spt.vmas;
+	void *start = pg_round_down (addr), *end = addr + length;
+
+	if (!vma_covers (vmas, start, end))
+		return false;
+
+	while (start < end) {
+		struct vma *vma = vma_find (vmas, start);
+		void *vma_end = vma->end < end ? vma->end : end;
+
+		vma_advise (vma, start, vma_end, advice);
+		start = vma->end;
+	}
+	return true;
+}
+
+/* Moves the program break of the current process by INCREMENT bytes
+ * and returns the old break, or (void *) -1 if the heap cannot move
+ * there.  The heap is one anonymous region from heap_start to the
+ * page holding the break; its pages are made on first touch, and
+ * pages the heap gives back are dropped. */
+void *
+vm_sbrk (intptr_t increment) {
+	struct supplemental_page_table *spt = &thread_current ()->spt;
+	void *old_brk = spt->brk, *brk = old_brk + increment;
+	void *old_end = pg_round_up (old_brk), *end = pg_round_up (brk);
+	struct vma *heap;
+
+	if (spt->heap_start == NULL
+			|| (increment < 0 && brk < spt->heap_start)
+			|| (increment > 0 && (brk < old_brk || !is_user_vaddr (brk))))
+		return (void *) -1;
+
+	heap = old_end > spt->heap_start ? vma_find (&spt->vmas, spt->heap_start)
+		: NULL;
+	if (end > old_end) {
+		if (heap == NULL)
+			heap = vma_create (&spt->vmas, spt->heap_start, end, VM_ANON, true,
+					NULL, 0, 0);
+		else if (!vma_set_end (&spt->vmas, heap, end))
+			heap = NULL;
+		if (heap == NULL)
+			return (void *) -1;
+	} else if (end < old_end) {
+		vma_remove_pages (heap, end, old_end);
+		if (end > spt->heap_start)
+			vma_set_end (&spt->vmas, heap, end);
+		else
+			vma_destroy (&spt->vmas, heap);
+	}
+
+	spt->brk = brk;
+	return old_brk;
+}
+
 /* Free the page.
  * DO NOT MODIFY THIS FUNCTION. */
 void
@@ -284,13 +1240,71 @@ vm_do_claim_page (struct page *page) {
 	/* TODO: Insert page table entry to map page's VA to frame's PA. */
 	pml4_set_page(curr->pml4, page->va, frame->kva, page->writable); // (va - pa) mapping
 
-	return swap_in (page, frame->kva);
+	if (!swap_in (page, frame->kva)) {
+		pml4_clear_page (curr->pml4, page->va);
+		page->frame = NULL;
+		lock_acquire (&frame_lock);
+		vm_frame_free (frame);
+		lock_release (&frame_lock);
+		return false;
+	}
+
+	/* Only now that the contents are in place may the frame be reclaimed. */
+	lock_acquire (&frame_lock);
+	frame_lru_move (frame, LRU_INACTIVE);
+	file_text_publish (page);
+	anon_swap_publish (page);
+	lock_release (&frame_lock);
+	return true;
 }
 
 /* Initialize new supplemental page table */
 void
 supplemental_page_table_init (struct supplemental_page_table *spt UNUSED) {
 	hash_init(&spt->spt_table, page_hash, page_less, NULL);
+	vma_tree_init(&spt->vmas);
+	spt->heap_start = spt->brk = NULL;
+	memset(spt->fault_around, 0, sizeof spt->fault_around);
+	spt->fault_around_next = 0;
+	memset(&spt->stats, 0, sizeof spt->stats);
+}
+
+/* Counts the pages of SPT that are in memory, by type.  Pages that
+ * only map the zero page do not count. */
+void
+spt_resident (struct supplemental_page_table *spt,
+		size_t *anon, size_t *file) {
+	struct hash_iterator i;
+
+	*anon = *file = 0;
+	lock_acquire (&frame_lock);
+	hash_first (&i, &spt->spt_table);
+	while (hash_next (&i)) {
+		struct page *page = hash_entry (hash_cur (&i), struct page, hash_elem);
+
+		if (page->frame == NULL)
+			continue;
+		if (page_get_type (page) == VM_FILE)
+			(*file)++;
+		else
+			(*anon)++;
+	}
+	lock_release (&frame_lock);
+}
+
+/* Prints the paging counters of SPT, which belongs to process NAME. */
+void
+spt_print_stats (struct supplemental_page_table *spt, const char *name) {
+	struct vm_stats *st = &spt->stats;
+	size_t anon, file;
+
+	spt_resident (spt, &anon, &file);
+	printf ("%s: vmstat: %"PRIu64" minor, %"PRIu64" major, %"PRIu64" stack "
+			"faults in %"PRIu64" cycles\n", name, st->minor_faults,
+			st->major_faults, st->stack_faults, st->fault_cycles);
+	printf ("%s: vmstat: %"PRIu64" swapped in, %"PRIu64" swapped out, "
+			"%"PRIu64" copy-on-write breaks, %zu anon + %zu file resident\n",
+			name, st->swap_ins, st->swap_outs, st->cow_breaks, anon, file);
 }
 
 /* 가상 주소에 대한 해시 값을 구하는 함수 */
@@ -313,6 +1327,12 @@ bool
 supplemental_page_table_copy (struct supplemental_page_table *dst UNUSED,
 		struct supplemental_page_table *src UNUSED) {
 	struct hash_iterator i;
+
+	// 영역을 먼저 복사해야 페이지가 제 영역을 찾는다.
+	if (!vma_tree_copy(&dst->vmas, &src->vmas))
+		return false;
+	dst->heap_start = src->heap_start;
+	dst->brk = src->brk;
 	hash_first(&i, &src->spt_table);
 	while (hash_next(&i))
 	{
@@ -327,38 +1347,62 @@ supplemental_page_table_copy (struct supplemental_page_table *dst UNUSED,
 		{ // uninit page 생성 & 초기화
 			vm_initializer *init = src_page->uninit.init;
 			void *aux = src_page->uninit.aux;
-			vm_alloc_page_with_initializer(VM_ANON, upage, writable, init, aux);
+			vm_alloc_page_with_initializer(src_page->uninit.type, upage, writable, init, aux);
 			continue;
 		}
 
 		/* 2) type이 file이면 */
 		if (VM_TYPE(type) == VM_FILE)
 		{
-			struct load_segment_aux *file_aux = malloc(sizeof(struct load_segment_aux));
-			file_aux->file = src_page->file.file;
-			file_aux->ofs = src_page->file.ofs;
-			file_aux->read_bytes = src_page->file.read_bytes;
-			file_aux->zero_bytes = src_page->file.zero_bytes;
-			if (!vm_alloc_page_with_initializer(type, upage, writable, NULL, file_aux))
+			// 파일은 자식 영역이 연 것을 쓴다. 정보는 초기화 때 복사된다.
+			struct load_segment_aux file_aux = {
+				.file = vma_find(&dst->vmas, upage)->file,
+				.ofs = src_page->file.ofs,
+				.read_bytes = src_page->file.read_bytes,
+				.zero_bytes = src_page->file.zero_bytes,
+			};
+			if (src_page->file.text)
+				type |= VM_TEXT;
+			if (!vm_alloc_page_with_initializer(type, upage, writable, NULL, &file_aux))
 				return false;
 			struct page *file_page = spt_find_page(dst, upage);
 			file_backed_initializer(file_page, type, NULL);
-			file_page->frame = src_page->frame;
-			pml4_set_page(thread_current()->pml4, file_page->va, src_page->frame->kva, src_page->writable);
+
+			// 부모의 프레임을 공유한다. 쫓겨난 페이지는 나중에 파일에서 다시 읽는다.
+			lock_acquire(&frame_lock);
+			if (src_page->frame != NULL)
+				vm_frame_share(src_page->frame, file_page);
+			lock_release(&frame_lock);
 			continue;
 		}
 
 		/* 3) type이 anon이면 */
 		if (!vm_alloc_page(type, upage, writable)) // uninit page 생성 & 초기화
 			return false;						   // init이랑 aux는 Lazy Loading에 필요. 지금 만드는 페이지는 기다리지 않고 바로 내용을 넣어줄 것이므로 필요 없음
+		struct page *dst_page = spt_find_page(dst, upage);
 
-		// vm_claim_page으로 요청해서 매핑 & 페이지 타입에 맞게 초기화
-		if (!vm_claim_page(upage))
-			return false;
+		// 프레임은 LRU에 올리기 전이라 복사하는 동안 쫓겨나지 않는다.
+		// 부모 페이지는 그 사이에 쫓겨났을 수 있으니 잠근 뒤에 본다.
+		struct frame *frame = vm_get_frame();
+		bool ok = true;
 
-		// 매핑된 프레임에 내용 로딩
-		struct page *dst_page = spt_find_page(dst, upage);
-		memcpy(dst_page->frame->kva, src_page->frame->kva, PGSIZE);
+		lock_acquire(&frame_lock);
+		if (src_page->frame == NULL) {
+			// 스왑된 페이지는 읽어 들이지 않고 스왑 슬롯을 함께 든다.
+			vm_frame_free(frame);
+			anon_fork_swapped(dst_page, src_page);
+		} else {
+			// 매핑된 프레임에 내용 로딩
+			memcpy(frame->kva, src_page->frame->kva, PGSIZE);
+			dst_page->uninit.page_initializer(dst_page, dst_page->uninit.type, frame->kva);
+			frame->page = dst_page;
+			dst_page->frame = frame;
+			ok = pml4_set_page(dst_page->pml4, upage, frame->kva, writable);
+			frame_lru_move(frame, LRU_INACTIVE);
+		}
+		lock_release(&frame_lock);
+		if (!ok)
+			return false;
 	}
 	return true;
 }
@@ -375,5 +1419,9 @@ void
 supplemental_page_table_kill (struct supplemental_page_table *spt UNUSED) {
 	/* TODO: Destroy all the supplemental_page_table hold by thread and
 	 * TODO: writeback all the modified contents to the storage. */
+	lock_acquire (&frame_lock);
 	hash_clear(&spt->spt_table, page_destory);
+	lock_release (&frame_lock);
+	vma_tree_clear(&spt->vmas);
+	spt->heap_start = spt->brk = NULL;
 }
@@ -0,0 +1,273 @@
+/* vma.c: Regions of a process's address space.
+ *
+ * Each process keeps its regions (executable segments, file mappings,
+ * the stack) in an AVL tree keyed by start address.  Regions never
+ * overlap, so the tree answers both "which region holds this address"
+ * and "is this range free" in O(log n), and mmap(), munmap() and fork()
+ * work per region instead of per page. */
+
+#include "vm/vm.h"
+#include "filesys/file.h"
+#include "threads/malloc.h"
+
+void
+vma_tree_init (struct vma_tree *tree) {
+	tree->root = NULL;
+}
+
+static int
+height (struct vma *n) {
+	return n != NULL ? n->height : 0;
+}
+
+static void
+update_height (struct vma *n) {
+	int l = height (n->left), r = height (n->right);
+	n->height = (l > r ? l : r) + 1;
+}
+
+static struct vma *
+rotate_right (struct vma *n) {
+	struct vma *l = n->left;
+
+	n->left = l->right;
+	l->right = n;
+	update_height (n);
+	update_height (l);
+	return l;
+}
+
+static struct vma *
+rotate_left (struct vma *n) {
+	struct vma *r = n->right;
+
+	n->right = r->left;
+	r->left = n;
+	update_height (n);
+	update_height (r);
+	return r;
+}
+
+/* Restores the AVL balance of the subtree rooted at N, whose children
+ * are balanced, and returns its new root. */
+static struct vma *
+rebalance (struct vma *n) {
+	int balance;
+
+	update_height (n);
+	balance = height (n->left) - height (n->right);
+	if (balance > 1) {
+		if (height (n->left->left) < height (n->left->right))
+			n->left = rotate_left (n->left);
+		return rotate_right (n);
+	}
+	if (balance < -1) {
+		if (height (n->right->right) < height (n->right->left))
+			n->right = rotate_right (n->right);
+		return rotate_left (n);
+	}
+	return n;
+}
+
+static struct vma *
+node_insert (struct vma *n, struct vma *vma) {
+	if (n == NULL)
+		return vma;
+	if (vma->start < n->start)
+		n->left = node_insert (n->left, vma);
+	else
+		n->right = node_insert (n->right, vma);
+	return rebalance (n);
+}
+
+/* Unlinks the leftmost node of the subtree N into *MIN and returns
+ * the subtree's new root. */
+static struct vma *
+node_remove_min (struct vma *n, struct vma **min) {
+	if (n->left == NULL) {
+		*min = n;
+		return n->right;
+	}
+	n->left = node_remove_min (n->left, min);
+	return rebalance (n);
+}
+
+static struct vma *
+node_remove (struct vma *n, struct vma *vma) {
+	struct vma *min;
+
+	ASSERT (n != NULL);
+
+	if (vma->start < n->start)
+		n->left = node_remove (n->left, vma);
+	else if (vma->start > n->start)
+		n->right = node_remove (n->right, vma);
+	else {
+		if (n->right == NULL)
+			return n->left;
+		n->right = node_remove_min (n->right, &min);
+		min->left = n->left;
+		min->right = n->right;
+		return rebalance (min);
+	}
+	return rebalance (n);
+}
+
+/* Creates the region [START, END) of TYPE and inserts it into TREE.
+ * Its first READ_BYTES bytes come from FILE at offset OFS, of which
+ * the region takes ownership.  Returns NULL if the range is not free
+ * or memory runs out. */
+struct vma *
+vma_create (struct vma_tree *tree, void *start, void *end,
+		enum vm_type type, bool writable, struct file *file, off_t ofs,
+		size_t read_bytes) {
+	struct vma *vma;
+
+	ASSERT (start < end);
+
+	if (vma_overlaps (tree, start, end) || (vma = malloc (sizeof *vma)) == NULL)
+		return NULL;
+
+	vma->start = start;
+	vma->end = end;
+	vma->type = type;
+	vma->writable = writable;
+	vma->sequential = false;
+	vma->mapped = false;
+	vma->file = file;
+	vma->ofs = ofs;
+	vma->read_bytes = read_bytes;
+	list_init (&vma->pages);
+	vma->left = vma->right = NULL;
+	vma->height = 1;
+	tree->root = node_insert (tree->root, vma);
+	return vma;
+}
+
+/* Removes VMA, whose pages must be gone already, from TREE and frees
+ * it along with its file. */
+void
+vma_destroy (struct vma_tree *tree, struct vma *vma) {
+	ASSERT (list_empty (&vma->pages));
+
+	tree->root = node_remove (tree->root, vma);
+	file_close (vma->file);
+	free (vma);
+}
+
+/* Returns the region of TREE that holds VA, or NULL. */
+struct vma *
+vma_find (struct vma_tree *tree, const void *va) {
+	struct vma *n = tree->root;
+
+	while (n != NULL) {
+		if (va < n->start)
+			n = n->left;
+		else if (va >= n->end)
+			n = n->right;
+		else
+			return n;
+	}
+	return NULL;
+}
+
+/* Returns whether any region of TREE overlaps [START, END). */
+bool
+vma_overlaps (struct vma_tree *tree, const void *start, const void *end) {
+	struct vma *n = tree->root;
+
+	while (n != NULL) {
+		if (end <= n->start)
+			n = n->left;
+		else if (start >= n->end)
+			n = n->right;
+		else
+			return true;
+	}
+	return false;
+}
+
+/* Returns whether regions of TREE cover all of [START, END). */
+bool
+vma_covers (struct vma_tree *tree, const void *start, const void *end) {
+	while (start < end) {
+		struct vma *vma = vma_find (tree, start);
+
+		if (vma == NULL)
+			return false;
+		start = vma->end;
+	}
+	return true;
+}
+
+/* Moves the start of VMA down to START, as the stack grows.  Returns
+ * false if that would run into another region. */
+bool
+vma_extend_down (struct vma_tree *tree, struct vma *vma, void *start) {
+	if (start >= vma->start)
+		return true;
+	if (vma_overlaps (tree, start, vma->start))
+		return false;
+
+	/* Nothing lies in between, so the order of the tree holds. */
+	vma->start = start;
+	return true;
+}
+
+/* Moves the end of VMA to END, as the heap grows or shrinks.  Pages
+ * past a new, lower END must be gone already.  Returns false if
+ * growing would run into another region. */
+bool
+vma_set_end (struct vma_tree *tree, struct vma *vma, void *end) {
+	ASSERT (end > vma->start);
+
+	if (end > vma->end && vma_overlaps (tree, vma->end, end))
+		return false;
+
+	/* The start is unchanged, so the order of the tree holds. */
+	vma->end = end;
+	return true;
+}
+
+static bool
+copy_subtree (struct vma_tree *dst, struct vma *n) {
+	struct vma *vma;
+	struct file *file = NULL;
+
+	if (n == NULL)
+		return true;
+	if (n->file != NULL && (file = file_reopen (n->file)) == NULL)
+		return false;
+	vma = vma_create (dst, n->start, n->end, n->type, n->writable, file,
+			n->ofs, n->read_bytes);
+	if (vma == NULL) {
+		file_close (file);
+		return false;
+	}
+	vma->sequential = n->sequential;
+	vma->mapped = n->mapped;
+	return copy_subtree (dst, n->left) && copy_subtree (dst, n->right);
+}
+
+/* Copies the regions of SRC, without their pages, into the empty DST. */
+bool
+vma_tree_copy (struct vma_tree *dst, struct vma_tree *src) {
+	return copy_subtree (dst, src->root);
+}
+
+static void
+free_subtree (struct vma *n) {
+	if (n == NULL)
+		return;
+	free_subtree (n->left);
+	free_subtree (n->right);
+	file_close (n->file);
+	free (n);
+}
+
+/* Frees every region of TREE.  Their pages must be gone already. */
+void
+vma_tree_clear (struct vma_tree *tree) {
+	free_subtree (tree->root);
+	tree->root = NULL;
+}
@@ -0,0 +1,188 @@
+/* writeback.c: Asynchronous writeback of dirty page cache pages.
+ *
+ * Writing each dirty page to its file on its own, one page per write,
+ * is slow.  Instead, the page cache queues its dirty pages here and a
+ * kernel thread writes them out.  It sorts what has piled up by file
+ * and offset, so that adjacent pages go out with a single write.
+ *
+ * A queued page is pinned and marked as under writeback by the page
+ * cache, which keeps it in memory and keeps it from being queued
+ * twice; the thread hands it back with page_cache_written().  Reads go
+ * through the page cache, which has the newest contents, so only
+ * those that want the contents in the file, like msync(), need to call
+ * writeback_wait(). */
+
+#include "vm/writeback.h"
+#include <inttypes.h>
+#include <list.h>
+#include <stdio.h>
+#include <string.h>
+#include "filesys/inode.h"
+#include "filesys/page_cache.h"
+#include "threads/palloc.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
+#include "vm/vm.h"
+
+/* Most pages written by one command, and most pages queued before
+ * writeback_page() waits for the thread to catch up. */
+#define WB_BATCH 16
+#define WB_MAX 32
+
+static struct lock wb_lock;
+static struct condition wb_work;       /* Signaled when queued. */
+static struct condition wb_done;       /* Broadcast when written. */
+static struct list wb_queue;           /* Waiting for the thread. */
+static struct list wb_busy;            /* Being written by the thread. */
+static size_t wb_pending;              /* Pages on both lists. */
+
+/* Bounce buffer for one coalesced write. */
+static uint8_t *wb_buf;
+
+/* Statistics. */
+static uint64_t wb_page_cnt;           /* Pages written. */
+static uint64_t wb_write_cnt;          /* Write commands issued. */
+
+static void writeback_thread (void *aux UNUSED);
+
+void
+writeback_init (void) {
+	lock_init (&wb_lock);
+	cond_init (&wb_work);
+	cond_init (&wb_done);
+	list_init (&wb_queue);
+	list_init (&wb_busy);
+	wb_buf = palloc_get_multiple (PAL_ASSERT, WB_BATCH);
+	thread_create ("writeback", PRI_DEFAULT, writeback_thread, NULL);
+}
+
+/* Queues PAGE, a page cache page pinned and marked as under writeback,
+ * to be written to its file.  May wait for the thread to catch up, so
+ * frame_lock must not be held. */
+void
+writeback_page (struct page *page) {
+	ASSERT (!lock_held_by_current_thread (&frame_lock));
+	ASSERT (page->page_cache.writeback);
+
+	lock_acquire (&wb_lock);
+	while (wb_pending >= WB_MAX)
+		cond_wait (&wb_done, &wb_lock);
+	list_push_back (&wb_queue, &page->page_cache.wb_elem);
+	wb_pending++;
+	cond_signal (&wb_work, &wb_lock);
+	lock_release (&wb_lock);
+}
+
+/* Returns whether LIST holds a page of INODE, or any page if INODE is
+ * NULL. */
+static bool
+list_has_inode (struct list *list, struct inode *inode) {
+	struct list_elem *el;
+
+	for (el = list_begin (list); el != list_end (list); el = list_next (el))
+		if (inode == NULL || list_entry (el, struct page,
+					page_cache.wb_elem)->page_cache.inode == inode)
+			return true;
+	return false;
+}
+
+/* Waits until every page queued for INODE, or for any file if INODE
+ * is NULL, has been written. */
+void
+writeback_wait (struct inode *inode) {
+	lock_acquire (&wb_lock);
+	while (list_has_inode (&wb_queue, inode) || list_has_inode (&wb_busy, inode))
+		cond_wait (&wb_done, &wb_lock);
+	lock_release (&wb_lock);
+}
+
+/* Orders pages by file, then offset. */
+static bool
+wb_less (const struct list_elem *a_, const struct list_elem *b_,
+		void *aux UNUSED) {
+	const struct page_cache *a = &list_entry (a_, struct page,
+			page_cache.wb_elem)->page_cache;
+	const struct page_cache *b = &list_entry (b_, struct page,
+			page_cache.wb_elem)->page_cache;
+
+	if (a->inode != b->inode)
+		return a->inode < b->inode;
+	return a->ofs < b->ofs;
+}
+
+/* Writes the pages on wb_busy, which is sorted, and empties it. */
+static void
+writeback_busy (void) {
+	while (!list_empty (&wb_busy)) {
+		struct page *run[WB_BATCH];
+		struct page_cache *first;
+		struct list_elem *el;
+		size_t cnt = 0, i;
+		off_t bytes;
+
+		/* Gather a run of adjacent pages of one file. */
+		first = &list_entry (list_front (&wb_busy), struct page,
+				page_cache.wb_elem)->page_cache;
+		for (el = list_begin (&wb_busy);
+				el != list_end (&wb_busy) && cnt < WB_BATCH;
+				el = list_next (el)) {
+			struct page *page = list_entry (el, struct page, page_cache.wb_elem);
+
+			if (page->page_cache.inode != first->inode
+					|| page->page_cache.ofs != first->ofs + (off_t) (cnt * PGSIZE))
+				break;
+			run[cnt++] = page;
+		}
+
+		/* Only the part before end of file is written. */
+		bytes = inode_length (first->inode) - first->ofs;
+		if (bytes > (off_t) (cnt * PGSIZE))
+			bytes = cnt * PGSIZE;
+		if (bytes > 0) {
+			if (cnt == 1)
+				inode_write_direct (first->inode, run[0]->frame->kva, bytes,
+						first->ofs);
+			else {
+				for (i = 0; i < cnt; i++)
+					memcpy (wb_buf + i * PGSIZE, run[i]->frame->kva, PGSIZE);
+				inode_write_direct (first->inode, wb_buf, bytes, first->ofs);
+			}
+			wb_write_cnt++;
+		}
+		wb_page_cnt += cnt;
+
+		lock_acquire (&wb_lock);
+		for (i = 0; i < cnt; i++)
+			list_remove (&run[i]->page_cache.wb_elem);
+		wb_pending -= cnt;
+		cond_broadcast (&wb_done, &wb_lock);
+		lock_release (&wb_lock);
+
+		/* Unpinned, a page may be freed at once. */
+		for (i = 0; i < cnt; i++)
+			page_cache_written (run[i]);
+	}
+}
+
+/* Takes whatever has been queued, in sorted order, and writes it. */
+static void
+writeback_thread (void *aux UNUSED) {
+	for (;;) {
+		lock_acquire (&wb_lock);
+		while (list_empty (&wb_queue))
+			cond_wait (&wb_work, &wb_lock);
+		while (!list_empty (&wb_queue))
+			list_push_back (&wb_busy, list_pop_front (&wb_queue));
+		list_sort (&wb_busy, wb_less, NULL);
+		lock_release (&wb_lock);
+
+		writeback_busy ();
+	}
+}
+
+void
+writeback_print_stats (void) {
+	printf ("VM: %"PRIu64" dirty pages written back in %"PRIu64" writes\n",
+			wb_page_cnt, wb_write_cnt);
+}
@@ -0,0 +1,489 @@
+/* zswap.c: Compressed in-memory tier in front of the swap disk.
+ *
+ * Anonymous pages on their way to swap are compressed with a small
+ * LZ77 compressor (LZ4 block format) and kept in a pool of kernel
+ * pages, keyed by the swap slot they were assigned.  Only when the
+ * pool grows past ZSWAP_POOL_MAX pages are the oldest entries
+ * decompressed again and written to their slot on disk.
+ *
+ * The pool is a "zbud" allocator: each pool page holds at most two
+ * objects, one packed at its start and one at its end, so freeing
+ * never leaves holes that need compaction.  Pages filled with a
+ * single repeated word (mostly zero pages) take no pool space at
+ * all. */
+
+#include "vm/zswap.h"
+#include <hash.h>
+#include <inttypes.h>
+#include <list.h>
+#include <round.h>
+#include <stdio.h>
+#include <string.h>
+#include "threads/malloc.h"
+#include "threads/palloc.h"
+#include "threads/synch.h"
+#include "threads/vaddr.h"
+
+/* Pages that do not compress below this are left to the disk. */
+#define ZSWAP_MAX_SIZE (PGSIZE * 3 / 4)
+
+/* zbud allocation granularity. */
+#define ZBUD_CHUNK 64
+#define ZBUD_CHUNKS (PGSIZE / ZBUD_CHUNK)
+
+/* One pool page. */
+struct zbud_page {
+	struct list_elem elem;        /* Element in zbud_pages. */
+	uint8_t *kva;                 /* The page itself. */
+	size_t first_chunks;          /* Chunks used at the start, 0 if free. */
+	size_t last_chunks;           /* Chunks used at the end, 0 if free. */
+};
+
+/* A compressed page. */
+struct zswap_entry {
+	struct hash_elem hash_elem;   /* Element in zswap_tree. */
+	struct list_elem lru_elem;    /* Element in zswap_lru. */
+	size_t slot;                  /* Swap slot this page belongs to. */
+	size_t size;                  /* Compressed size, 0 if same-filled. */
+	uint64_t fill;                /* Repeated word, if same-filled. */
+	struct zbud_page *zpage;      /* Pool page holding the data. */
+	bool last;                    /* Stored at the end of ZPAGE? */
+};
+
+static struct lock zswap_lock;
+static struct hash zswap_tree;
+static struct list zswap_lru;        /* Oldest entry at the front. */
+static struct list zbud_pages;
+static size_t zbud_page_cnt;
+
+/* Compressor work area, used under zswap_lock. */
+#define LZ_MIN_MATCH 4
+#define LZ_HASH_BITS 12
+static uint16_t lz_table[1 << LZ_HASH_BITS];
+static uint8_t *zswap_buf;
+
+/* Statistics. */
+static uint64_t stored_cnt;
+static uint64_t same_filled_cnt;
+static uint64_t reject_cnt;
+static uint64_t load_cnt;
+static uint64_t writeback_cnt;
+
+static uint64_t zswap_hash (const struct hash_elem *e, void *aux UNUSED);
+static bool zswap_less (const struct hash_elem *a,
+		const struct hash_elem *b, void *aux UNUSED);
+
+void
+zswap_init (void) {
+	lock_init (&zswap_lock);
+	hash_init (&zswap_tree, zswap_hash, zswap_less, NULL);
+	list_init (&zswap_lru);
+	list_init (&zbud_pages);
+	zswap_buf = palloc_get_page (PAL_ASSERT);
+}
+
+static uint64_t
+zswap_hash (const struct hash_elem *e, void *aux UNUSED) {
+	const struct zswap_entry *entry =
+		hash_entry (e, struct zswap_entry, hash_elem);
+	return hash_bytes (&entry->slot, sizeof entry->slot);
+}
+
+static bool
+zswap_less (const struct hash_elem *a, const struct hash_elem *b,
+		void *aux UNUSED) {
+	return hash_entry (a, struct zswap_entry, hash_elem)->slot
+		< hash_entry (b, struct zswap_entry, hash_elem)->slot;
+}
+
+/* ---------------------------------------------------------------- */
+/* LZ compressor.                                                   */
+/* ---------------------------------------------------------------- */
+
+static uint32_t
+lz_read32 (const uint8_t *p) {
+	uint32_t v;
+	memcpy (&v, p, sizeof v);
+	return v;
+}
+
+static unsigned
+lz_hash (uint32_t v) {
+	return (v * 2654435761u) >> (32 - LZ_HASH_BITS);
+}
+
+/* Appends the extra bytes of a length field of value N. */
+static void
+lz_put_len (uint8_t **opp, size_t n) {
+	uint8_t *op = *opp;
+	for (; n >= 255; n -= 255)
+		*op++ = 255;
+	*op++ = n;
+	*opp = op;
+}
+
+/* Appends one sequence: LIT_LEN literals at LIT followed by a match
+ * of MATCH_LEN bytes OFFSET bytes back.  MATCH_LEN 0 marks the last
+ * sequence, which has no match.  Returns false if the sequence does
+ * not fit before OEND. */
+static bool
+lz_emit (uint8_t **opp, uint8_t *oend, const uint8_t *lit, size_t lit_len,
+		size_t offset, size_t match_len) {
+	uint8_t *op = *opp;
+	size_t ml = match_len ? match_len - LZ_MIN_MATCH : 0;
+	size_t need = 1 + lit_len + lit_len / 255 + 1
+		+ (match_len ? 2 + ml / 255 + 1 : 0);
+
+	if (need > (size_t) (oend - op))
+		return false;
+
+	*op++ = ((lit_len < 15 ? lit_len : 15) << 4) | (ml < 15 ? ml : 15);
+	if (lit_len >= 15)
+		lz_put_len (&op, lit_len - 15);
+	memcpy (op, lit, lit_len);
+	op += lit_len;
+	if (match_len) {
+		*op++ = offset & 0xff;
+		*op++ = offset >> 8;
+		if (ml >= 15)
+			lz_put_len (&op, ml - 15);
+	}
+	*opp = op;
+	return true;
+}
+
+/* Compresses LEN bytes at SRC into DST, which has room for CAP
+ * bytes.  Returns the compressed size, or 0 if it exceeds CAP. */
+static size_t
+lz_compress (const uint8_t *src, size_t len, uint8_t *dst, size_t cap) {
+	const uint8_t *ip = src, *anchor = src;
+	const uint8_t *end = src + len;
+	uint8_t *op = dst, *oend = dst + cap;
+
+	memset (lz_table, 0, sizeof lz_table);
+	while (ip + LZ_MIN_MATCH <= end) {
+		uint32_t seq = lz_read32 (ip);
+		unsigned h = lz_hash (seq);
+		const uint8_t *ref = src + lz_table[h];
+		const uint8_t *mp, *rp;
+
+		lz_table[h] = ip - src;
+		if (ref >= ip || lz_read32 (ref) != seq) {
+			ip++;
+			continue;
+		}
+
+		for (mp = ip + LZ_MIN_MATCH, rp = ref + LZ_MIN_MATCH;
+				mp < end && *mp == *rp; mp++, rp++)
+			continue;
+		if (!lz_emit (&op, oend, anchor, ip - anchor, ip - ref, mp - ip))
+			return 0;
+		ip = anchor = mp;
+	}
+	if (!lz_emit (&op, oend, anchor, end - anchor, 0, 0))
+		return 0;
+	return op - dst;
+}
+
+/* Reads the extra bytes of a length field.  Returns false if they
+ * run past IEND. */
+static bool
+lz_get_len (const uint8_t **ipp, const uint8_t *iend, size_t *n) {
+	const uint8_t *ip = *ipp;
+	uint8_t b;
+
+	do {
+		if (ip >= iend)
+			return false;
+		b = *ip++;
+		*n += b;
+	} while (b == 255);
+	*ipp = ip;
+	return true;
+}
+
+/* Decompresses LEN bytes at SRC into exactly CAP bytes at DST.
+ * Returns false if the input is malformed. */
+static bool
+lz_decompress (const uint8_t *src, size_t len, uint8_t *dst, size_t cap) {
+	const uint8_t *ip = src, *iend = src + len;
+	uint8_t *op = dst, *oend = dst + cap;
+
+	while (ip < iend) {
+		uint8_t token = *ip++;
+		size_t lit_len = token >> 4, match_len = token & 15, offset;
+		const uint8_t *ref;
+
+		if (lit_len == 15 && !lz_get_len (&ip, iend, &lit_len))
+			return false;
+		if (lit_len > (size_t) (iend - ip) || lit_len > (size_t) (oend - op))
+			return false;
+		memcpy (op, ip, lit_len);
+		op += lit_len;
+		ip += lit_len;
+
+		/* The last sequence ends with its literals. */
+		if (ip == iend)
+			break;
+
+		if (iend - ip < 2)
+			return false;
+		offset = ip[0] | (ip[1] << 8);
+		ip += 2;
+		if (match_len == 15 && !lz_get_len (&ip, iend, &match_len))
+			return false;
+		match_len += LZ_MIN_MATCH;
+		if (offset == 0 || offset > (size_t) (op - dst)
+				|| match_len > (size_t) (oend - op))
+			return false;
+
+		/* Byte by byte: the match may overlap its own output. */
+		for (ref = op - offset; match_len > 0; match_len--)
+			*op++ = *ref++;
+	}
+	return op == oend;
+}
+
+/* ---------------------------------------------------------------- */
+/* zbud pool.                                                       */
+/* ---------------------------------------------------------------- */
+
+static size_t
+zbud_free_chunks (const struct zbud_page *zpage) {
+	return ZBUD_CHUNKS - zpage->first_chunks - zpage->last_chunks;
+}
+
+static uint8_t *
+zbud_data (const struct zswap_entry *entry) {
+	struct zbud_page *zpage = entry->zpage;
+	return entry->last
+		? zpage->kva + (ZBUD_CHUNKS - zpage->last_chunks) * ZBUD_CHUNK
+		: zpage->kva;
+}
+
+/* Finds room for ENTRY->size bytes, adding a pool page if no page
+ * has a free half large enough.  Returns false if out of memory. */
+static bool
+zbud_alloc (struct zswap_entry *entry) {
+	size_t chunks = DIV_ROUND_UP (entry->size, ZBUD_CHUNK);
+	struct zbud_page *zpage = NULL;
+	struct list_elem *e;
+
+	for (e = list_begin (&zbud_pages); e != list_end (&zbud_pages);
+			e = list_next (e)) {
+		struct zbud_page *p = list_entry (e, struct zbud_page, elem);
+		if ((p->first_chunks == 0 || p->last_chunks == 0)
+				&& zbud_free_chunks (p) >= chunks) {
+			zpage = p;
+			break;
+		}
+	}
+
+	if (zpage == NULL) {
+		zpage = malloc (sizeof *zpage);
+		if (zpage == NULL)
+			return false;
+		zpage->kva = palloc_get_page (0);
+		if (zpage->kva == NULL) {
+			free (zpage);
+			return false;
+		}
+		zpage->first_chunks = zpage->last_chunks = 0;
+		list_push_back (&zbud_pages, &zpage->elem);
+		zbud_page_cnt++;
+	}
+
+	entry->zpage = zpage;
+	entry->last = zpage->first_chunks != 0;
+	if (entry->last)
+		zpage->last_chunks = chunks;
+	else
+		zpage->first_chunks = chunks;
+	return true;
+}
+
+/* Releases the pool space of ENTRY, and its page once both halves
+ * are free. */
+static void
+zbud_free (struct zswap_entry *entry) {
+	struct zbud_page *zpage = entry->zpage;
+
+	if (entry->last)
+		zpage->last_chunks = 0;
+	else
+		zpage->first_chunks = 0;
+
+	if (zpage->first_chunks == 0 && zpage->last_chunks == 0) {
+		list_remove (&zpage->elem);
+		palloc_free_page (zpage->kva);
+		free (zpage);
+		zbud_page_cnt--;
+	}
+}
+
+/* ---------------------------------------------------------------- */
+/* Entries.                                                         */
+/* ---------------------------------------------------------------- */
+
+static struct zswap_entry *
+zswap_find (size_t slot) {
+	struct zswap_entry key;
+	struct hash_elem *e;
+
+	key.slot = slot;
+	e = hash_find (&zswap_tree, &key.hash_elem);
+	return e != NULL ? hash_entry (e, struct zswap_entry, hash_elem) : NULL;
+}
+
+static void
+zswap_remove (struct zswap_entry *entry) {
+	hash_delete (&zswap_tree, &entry->hash_elem);
+	list_remove (&entry->lru_elem);
+	if (entry->size != 0)
+		zbud_free (entry);
+	free (entry);
+}
+
+/* Returns true and sets *FILL if the page at KVA is one word
+ * repeated. */
+static bool
+page_same_filled (const void *kva, uint64_t *fill) {
+	const uint64_t *w = kva;
+	size_t i;
+
+	for (i = 1; i < PGSIZE / sizeof *w; i++)
+		if (w[i] != w[0])
+			return false;
+	*fill = w[0];
+	return true;
+}
+
+/* Expands ENTRY into the page at KVA. */
+static void
+zswap_decompress (const struct zswap_entry *entry, void *kva) {
+	if (entry->size == 0) {
+		uint64_t *w = kva;
+		size_t i;
+
+		for (i = 0; i < PGSIZE / sizeof *w; i++)
+			w[i] = entry->fill;
+	} else if (!lz_decompress (zbud_data (entry), entry->size, kva, PGSIZE))
+		PANIC ("zswap: slot %zu is corrupted", entry->slot);
+}
+
+/* Stores a compressed copy of the page at KVA as the contents of
+ * SLOT.  Returns false if the page does not compress well enough or
+ * there is no memory, in which case it must go to disk. */
+bool
+zswap_store (size_t slot, const void *kva) {
+	struct zswap_entry *entry = malloc (sizeof *entry);
+
+	if (entry == NULL)
+		return false;
+	entry->slot = slot;
+
+	lock_acquire (&zswap_lock);
+	ASSERT (zswap_find (slot) == NULL);
+	if (page_same_filled (kva, &entry->fill)) {
+		entry->size = 0;
+		same_filled_cnt++;
+	} else {
+		entry->size = lz_compress (kva, PGSIZE, zswap_buf, ZSWAP_MAX_SIZE);
+		if (entry->size == 0 || !zbud_alloc (entry)) {
+			reject_cnt++;
+			lock_release (&zswap_lock);
+			free (entry);
+			return false;
+		}
+		memcpy (zbud_data (entry), zswap_buf, entry->size);
+	}
+	hash_insert (&zswap_tree, &entry->hash_elem);
+	list_push_back (&zswap_lru, &entry->lru_elem);
+	stored_cnt++;
+	lock_release (&zswap_lock);
+	return true;
+}
+
+/* If SLOT is in the pool, decompresses it into KVA, drops it from
+ * the pool and returns true. */
+bool
+zswap_load (size_t slot, void *kva) {
+	struct zswap_entry *entry;
+
+	lock_acquire (&zswap_lock);
+	entry = zswap_find (slot);
+	if (entry != NULL) {
+		zswap_decompress (entry, kva);
+		zswap_remove (entry);
+		load_cnt++;
+	}
+	lock_release (&zswap_lock);
+	return entry != NULL;
+}
+
+/* Returns true if SLOT is in the pool, meaning its disk copy is
+ * stale. */
+bool
+zswap_contains (size_t slot) {
+	bool found;
+
+	lock_acquire (&zswap_lock);
+	found = zswap_find (slot) != NULL;
+	lock_release (&zswap_lock);
+	return found;
+}
+
+/* Drops SLOT from the pool, if it is there. */
+void
+zswap_invalidate (size_t slot) {
+	struct zswap_entry *entry;
+
+	lock_acquire (&zswap_lock);
+	entry = zswap_find (slot);
+	if (entry != NULL)
+		zswap_remove (entry);
+	lock_release (&zswap_lock);
+}
+
+/* Returns true if the pool holds more pages than it may. */
+bool
+zswap_over_budget (void) {
+	return zbud_page_cnt > ZSWAP_POOL_MAX;
+}
+
+/* Takes the oldest compressed entry out of the pool, decompressing it into KVA
+ * and its slot into *SLOT, so that the caller can write it to disk.
+ * Returns false if there is no such entry. */
+bool
+zswap_evict (size_t *slot, void *kva) {
+	struct zswap_entry *entry = NULL;
+	struct list_elem *e;
+
+	lock_acquire (&zswap_lock);
+	/* Same-filled entries take no pool space; writing them back
+	 * would not bring the pool under budget. */
+	for (e = list_begin (&zswap_lru); e != list_end (&zswap_lru);
+			e = list_next (e)) {
+		entry = list_entry (e, struct zswap_entry, lru_elem);
+		if (entry->size != 0)
+			break;
+		entry = NULL;
+	}
+	if (entry != NULL) {
+		*slot = entry->slot;
+		zswap_decompress (entry, kva);
+		zswap_remove (entry);
+		writeback_cnt++;
+	}
+	lock_release (&zswap_lock);
+	return entry != NULL;
+}
+
+void
+zswap_print_stats (void) {
+	printf ("zswap: %"PRIu64" stored (%"PRIu64" same-filled), "
+			"%"PRIu64" rejected, %"PRIu64" loaded, %"PRIu64" written back, "
+			"%zu pool pages\n",
+			stored_cnt, same_filled_cnt, reject_cnt, load_cnt, writeback_cnt,
+			zbud_page_cnt);
+}